@@ -1,37 +1,92 @@
 #pragma once
 
 #include "futex_like.hpp"
+#include "contention.hpp"
 
 #include <tpcc/stdlike/atomic.hpp>
 
+#include <cstddef>
+#include <cstdint>
 #include <mutex>
 
 namespace tpcc {
 namespace solutions {
 
+// Three-state futex mutex: uncontended Lock is a single CAS and
+// uncontended Unlock is a single exchange. Before parking Lock spins
+// for a while; the spin budget follows how long the lock was recently
+// held, measured in spin iterations of contended acquisitions
+
 class AdaptiveLock {
+  static const uint32_t kUnlocked = 0;
+  static const uint32_t kLocked = 1;
+  // locked and somebody may be parked on the futex
+  static const uint32_t kContended = 2;
+
+  static const int64_t kMinSpins = 16;
+  static const int64_t kMaxSpins = 2048;
+
  public:
   AdaptiveLock() {
   }
 
   void Lock() {
-    threads_in_queue_.fetch_add(1);
-    while (lock_.exchange(true)) {
-      futex_.Wait(true);
+    uint32_t state_value_ = kUnlocked;
+    if (state_.compare_exchange_strong(state_value_, kLocked)) {
+      return void();
+    }
+    if (TrySpin()) {
+      return void();
+    }
+    state_value_ = state_.exchange(kContended);
+    while (state_value_ != kUnlocked) {
+      contention::WaitTimer wait_timer_;
+      futex_.Wait(kContended);
+      state_value_ = state_.exchange(kContended);
     }
   }
 
   void Unlock() {
-    lock_.store(false);
-    if (threads_in_queue_.fetch_sub(1) > 1) {
+    if (state_.exchange(kUnlocked) == kContended) {
+      contention::Count(contention::kUnparks);
       futex_.WakeOne();
     }
   }
 
  private:
-  atomic<bool> lock_{false}, for_futex_{false};
-  atomic<size_t> threads_in_queue_{0};
-  FutexLike<bool> futex_{for_futex_};
+  // spins up to twice the current budget and moves the budget 1/8 of
+  // the way towards the number of spins it actually took
+  bool TrySpin() {
+    const int64_t spin_limit_value_ = spin_limit_.load();
+    const int64_t max_spins_ = spin_limit_value_ * 2 < kMaxSpins
+                                   ? spin_limit_value_ * 2
+                                   : kMaxSpins;
+    for (int64_t i = 0; i < max_spins_; ++i) {
+      uint32_t unlocked_ = kUnlocked;
+      if (state_.load() == kUnlocked &&
+          state_.compare_exchange_weak(unlocked_, kLocked)) {
+        contention::Count(contention::kSpinIterations, i);
+        AdjustSpinLimit(spin_limit_value_, i);
+        return true;
+      }
+    }
+    contention::Count(contention::kSpinIterations, max_spins_);
+    AdjustSpinLimit(spin_limit_value_, max_spins_);
+    return false;
+  }
+
+  void AdjustSpinLimit(const int64_t current, const int64_t spins) {
+    int64_t adjusted_ = current + (spins - current) / 8;
+    if (adjusted_ < kMinSpins) {
+      adjusted_ = kMinSpins;
+    }
+    spin_limit_.store(adjusted_);
+  }
+
+ private:
+  tpcc::atomic<uint32_t> state_{kUnlocked};
+  tpcc::atomic<int64_t> spin_limit_{kMinSpins};
+  FutexLike<uint32_t> futex_{state_};
 };
 
 }  // namespace solutions
@@ -1,14 +1,76 @@
 #pragma once
 
+#include "contention.hpp"
+
 #include <tpcc/concurrency/backoff.hpp>
 #include <tpcc/support/compiler.hpp>
 #include <tpcc/stdlike/atomic.hpp>
 
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
 #include <vector>
 
 namespace tpcc {
 namespace solutions {
 
+namespace detail {
+
+// Fixed-size array of default-constructed elements. Neither plain new
+// nor std::allocator honours extended alignment before C++17, so the
+// storage comes from posix_memalign
+
+template <typename T>
+class AlignedArray {
+ public:
+  explicit AlignedArray(size_t size) : size_(size) {
+    const size_t alignment_ = std::max(alignof(T), sizeof(void*));
+    void* memory_ = nullptr;
+    if (posix_memalign(&memory_, alignment_,
+                       std::max<size_t>(size, 1) * sizeof(T)) != 0) {
+      throw std::bad_alloc();
+    }
+    items_ = static_cast<T*>(memory_);
+    for (size_t i = 0; i < size_; ++i) {
+      new (items_ + i) T{};
+    }
+  }
+
+  AlignedArray(const AlignedArray&) = delete;
+  AlignedArray& operator=(const AlignedArray&) = delete;
+
+  ~AlignedArray() {
+    for (size_t i = 0; i < size_; ++i) {
+      items_[i].~T();
+    }
+    std::free(items_);
+  }
+
+  T& operator[](size_t index) {
+    return items_[index];
+  }
+
+  const T& operator[](size_t index) const {
+    return items_[index];
+  }
+
+  size_t GetSize() const {
+    return size_;
+  }
+
+ private:
+  T* items_{nullptr};
+  size_t size_;
+};
+
+}  // namespace detail
+
+////////////////////////////////////////////////////////////////////////////////
+
 class PetersonLock {
  public:
   PetersonLock() {
@@ -23,6 +85,7 @@ class PetersonLock {
     Backoff backoff{};
     while (want_[1 - thread_index].load() && victim_.load() == thread_index) {
       backoff();
+      contention::Count(contention::kSpinIterations);
     }
   }
 
@@ -35,14 +98,142 @@ class PetersonLock {
   atomic<size_t> victim_;
 };
 
+////////////////////////////////////////////////////////////////////////////////
+
+// Hands out slot indices in [0, capacity) to threads on first use and
+// takes them back when the thread exits. Slots are looked up in a
+// thread-local list, so a registered thread pays no atomics per lookup.
+// The registry may die before the threads that used it.
+//
+// At most capacity threads may hold a slot at the same time: a thread
+// holds it from its first lookup until it exits. Exceeding the bound is
+// a precondition violation and aborts the program
+class ThreadSlotRegistry {
+  static const size_t kCacheLineSize = 64;
+
+  struct alignas(kCacheLineSize) SlotFlag {
+    tpcc::atomic<bool> taken_{false};
+  };
+
+  struct State {
+    explicit State(size_t capacity) : slots_(capacity) {
+    }
+
+    detail::AlignedArray<SlotFlag> slots_;
+  };
+
+  struct Lease {
+    uint64_t registry_id_;
+    std::weak_ptr<State> state_;
+    size_t slot_;
+  };
+
+  // releases all slots of the thread at its exit
+  struct ThreadLeases {
+    ~ThreadLeases() {
+      for (Lease& lease_ : leases_) {
+        if (auto state_ = lease_.state_.lock()) {
+          state_->slots_[lease_.slot_].taken_.store(false);
+        }
+      }
+    }
+
+    std::vector<Lease> leases_;
+  };
+
+ public:
+  explicit ThreadSlotRegistry(size_t capacity)
+      : id_(NextRegistryId()), state_(std::make_shared<State>(capacity)) {
+  }
+
+  size_t GetCurrentThreadSlot() {
+    ThreadLeases& thread_leases_ = GetThreadLeases();
+    for (const Lease& lease_ : thread_leases_.leases_) {
+      if (lease_.registry_id_ == id_) {
+        return lease_.slot_;
+      }
+    }
+    return Register(thread_leases_);
+  }
+
+  size_t GetCapacity() const {
+    return state_->slots_.GetSize();
+  }
+
+ private:
+  size_t Register(ThreadLeases& thread_leases) {
+    // drop leases of registries that no longer exist
+    auto& leases_ = thread_leases.leases_;
+    for (size_t i = 0; i < leases_.size();) {
+      if (leases_[i].state_.expired()) {
+        leases_[i] = std::move(leases_.back());
+        leases_.pop_back();
+      } else {
+        ++i;
+      }
+    }
+
+    auto& slots_ = state_->slots_;
+    for (size_t slot_ = 0; slot_ < slots_.GetSize(); ++slot_) {
+      bool free_ = false;
+      if (!slots_[slot_].taken_.load() &&
+          slots_[slot_].taken_.compare_exchange_strong(free_, true)) {
+        leases_.push_back(Lease{id_, state_, slot_});
+        return slot_;
+      }
+    }
+    assert(false && "more live threads than registry slots");
+    std::abort();
+  }
+
+  static ThreadLeases& GetThreadLeases() {
+    static thread_local ThreadLeases leases_;
+    return leases_;
+  }
+
+  static uint64_t NextRegistryId() {
+    static tpcc::atomic<uint64_t> next_id_{0};
+    return next_id_.fetch_add(1);
+  }
+
+ private:
+  const uint64_t id_;
+  std::shared_ptr<State> state_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Locks are stored level by level (root at 0, children of i at 2i+1 and
+// 2i+2), so the hot upper levels are contiguous and each lock is padded.
+// Threads either pass their own index or let the registry assign one;
+// don't mix the two on the same lock. Either way at most num_threads
+// threads may use the lock at the same time
 class TournamentTreeLock {
+  static const size_t kCacheLineSize = 64;
+
+  // every lock sits on its own cache line, so threads climbing sibling
+  // subtrees don't invalidate each other
+  struct alignas(kCacheLineSize) PaddedLock {
+    PetersonLock lock_;
+  };
+
  public:
-  explicit TournamentTreeLock(size_t num_threads) {
-    tree_base_ = 2;
-    while (num_threads > tree_base_) {
-      tree_base_ <<= 1;
+  explicit TournamentTreeLock(size_t num_threads)
+      : tree_base_(GetTreeBase(num_threads)),
+        tree_depth_(1),
+        locks_(tree_base_ - 1),
+        registry_(num_threads) {
+    while ((size_t{1} << tree_depth_) < tree_base_) {
+      ++tree_depth_;
     }
-    locks_ = std::vector<PetersonLock>(tree_base_);
+  }
+
+  void Lock() {
+    Lock(registry_.GetCurrentThreadSlot());
+  }
+
+  void Unlock() {
+    Unlock(registry_.GetCurrentThreadSlot());
   }
 
   void Lock(size_t thread_index) {
@@ -51,33 +242,37 @@ class TournamentTreeLock {
     while (current_lock_ != 0) {
       child_type_ = current_lock_ % 2;
       current_lock_ = GetParent(current_lock_);
-      locks_[current_lock_].Lock(child_type_);
+      locks_[current_lock_].lock_.Lock(child_type_);
     }
   }
 
-  void RecurrentUnlock(size_t leaf_index, size_t child_type) {
-    if (leaf_index != 0) {
-      RecurrentUnlock(GetParent(leaf_index), leaf_index % 2);
+  // releases the path top-down, the reverse of the acquisition order
+  void Unlock(size_t thread_index) {
+    const size_t leaf_ = GetThreadLeaf(thread_index);
+    for (size_t level_ = 0; level_ < tree_depth_; ++level_) {
+      const size_t child_ = GetAncestor(leaf_, level_ + 1);
+      locks_[GetAncestor(leaf_, level_)].lock_.Unlock(child_ % 2);
     }
-    locks_[leaf_index].Unlock(child_type);
   }
 
-  void Unlock(size_t thread_index) {
-    RecurrentUnlock(GetParent(GetThreadLeaf(thread_index)),
-                    GetThreadLeaf(thread_index) % 2);
+ private:
+  // number of leaves: the least power of two, at least 2, that fits
+  // num_threads
+  static size_t GetTreeBase(size_t num_threads) {
+    size_t tree_base_ = 2;
+    while (num_threads > tree_base_) {
+      tree_base_ <<= 1;
+    }
+    return tree_base_;
   }
 
- private:
   size_t GetParent(size_t node_index) const {
     return (node_index + 1) / 2 - 1;
   }
 
-  size_t GetLeftChild(size_t node_index) const {
-    return (node_index + 1) * 2 - 1;
-  }
-
-  size_t GetRightChild(size_t node_index) const {
-    return (node_index + 1) * 2;
+  // ancestor of a leaf lying at the given level, the root is level 0
+  size_t GetAncestor(size_t leaf_index, size_t level) const {
+    return ((leaf_index + 1) >> (tree_depth_ - level)) - 1;
   }
 
   size_t GetThreadLeaf(size_t thread_index) const {
@@ -86,7 +281,9 @@ class TournamentTreeLock {
 
  private:
   size_t tree_base_;
-  std::vector<PetersonLock> locks_;
+  size_t tree_depth_;
+  detail::AlignedArray<PaddedLock> locks_;
+  ThreadSlotRegistry registry_;
 };
 
 }  // namespace solutions
@@ -1,9 +1,14 @@
 #pragma once
 
+#include "contention.hpp"
+
 #include <tpcc/concurrency/backoff.hpp>
 
 #include <tpcc/stdlike/atomic.hpp>
 
+#include <array>
+#include <cstddef>
+
 namespace tpcc {
 namespace solutions {
 
@@ -36,5 +41,87 @@ class TicketLock {
   tpcc::atomic<size_t> owner_ticket_{0};
 };
 
+////////////////////////////////////////////////////////////////////////////////
+
+// Partitioned ticket lock: a waiter spins on one of kSlots grant slots,
+// picked by its ticket, so an Unlock invalidates the line of a few
+// waiters instead of all of them. A waiter further back in the queue
+// backs off proportionally to its distance from the owner's ticket,
+// re-reading now_serving_ once per backoff; the next waiter in line just
+// polls its slot. FIFO order is the same as in TicketLock
+
+class PartitionedTicketLock {
+  static const size_t kSlots = 8;
+  static const size_t kCacheLineSize = 64;
+  // pause iterations per ticket ahead of us
+  static const size_t kBackoffPerTicket = 32;
+
+  struct alignas(kCacheLineSize) GrantSlot {
+    tpcc::atomic<size_t> granted_ticket_{0};
+  };
+
+ public:
+  PartitionedTicketLock() = default;
+
+  void Lock() {
+    const size_t this_thread_ticket = next_free_ticket_.fetch_add(1);
+    GrantSlot& slot_ = GetSlot(this_thread_ticket);
+    // tickets ahead of us, the owner's included
+    size_t distance_ = this_thread_ticket - now_serving_.load();
+    Backoff backoff{};
+    while (slot_.granted_ticket_.load() != this_thread_ticket) {
+      if (distance_ > 1) {
+        Pause((distance_ - 1) * kBackoffPerTicket);
+        backoff();
+        distance_ = this_thread_ticket - now_serving_.load();
+      } else {
+        Pause(1);
+      }
+      contention::Count(contention::kSpinIterations);
+    }
+    owner_ticket_ = this_thread_ticket;
+  }
+
+  // succeeds iff nobody holds or waits for the lock
+  bool TryLock() {
+    size_t last_served_ticket_{now_serving_.load()};
+    if (!next_free_ticket_.compare_exchange_strong(last_served_ticket_,
+                                                   last_served_ticket_ + 1)) {
+      return false;
+    }
+    owner_ticket_ = last_served_ticket_;
+    return true;
+  }
+
+  // the grant is published before now_serving_, so TryLock never takes
+  // a ticket whose grant may still be written to a reused slot
+  void Unlock() {
+    const size_t next_ticket_ = owner_ticket_ + 1;
+    GetSlot(next_ticket_).granted_ticket_.store(next_ticket_);
+    now_serving_.store(next_ticket_);
+  }
+
+ private:
+  GrantSlot& GetSlot(const size_t ticket) {
+    return grant_slots_[ticket % kSlots];
+  }
+
+  static void Pause(const size_t iterations) {
+    for (size_t i = 0; i < iterations; ++i) {
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_ia32_pause();
+#endif
+    }
+  }
+
+ private:
+  std::array<GrantSlot, kSlots> grant_slots_;
+  alignas(kCacheLineSize) tpcc::atomic<size_t> next_free_ticket_{0};
+  // owner's ticket, read by TryLock and by waiters between backoffs
+  tpcc::atomic<size_t> now_serving_{0};
+  // written and read by the owner only
+  size_t owner_ticket_{0};
+};
+
 }  // namespace solutions
 }  // namespace tpcc
@@ -1,8 +1,11 @@
 #pragma once
 
+#include "contention.hpp"
+
+#include <tpcc/stdlike/atomic.hpp>
 #include <tpcc/stdlike/condition_variable.hpp>
 
-#include <iostream>
+#include <chrono>
 #include <cstddef>
 #include <deque>
 #include <mutex>
@@ -17,8 +20,16 @@ class QueueClosed : public std::runtime_error {
   }
 };
 
+// Blocking operations spin for a while before parking on a condition
+// variable. The spin budget adapts: it grows while items show up during
+// spinning and shrinks while they don't, so a loaded queue parks almost
+// immediately. Notifications are skipped when nobody is parked
+
 template <typename T, class Container = std::deque<T>>
 class BlockingQueue {
+  static const size_t kMinSpins = 16;
+  static const size_t kMaxSpins = 4096;
+
  public:
   // capacity == 0 means queue is unbounded
   explicit BlockingQueue(const size_t capacity = 0) : capacity_(capacity) {
@@ -26,37 +37,131 @@ class BlockingQueue {
 
   // throws QueueClosed exception after Close
   void Put(T item) {
+    SpinWhile([&] { return LooksFull(); });
     std::unique_lock<std::mutex> lock{mutex_};
-
-    wait_put_.wait(lock, [&] { return !IsFull() || closed_; });
-    if (IsFull() || closed_) {
+    WaitPut(lock);
+    if (closed_) {
       throw tpcc::solutions::QueueClosed();
-    } else {
-      items_.push_back(std::move(item));
-      wait_get_.notify_one();
     }
+    PushItem(lock, std::move(item));
   }
 
   // returns false iff queue is empty and closed
   bool Get(T& item) {
+    SpinWhile([&] { return LooksEmpty(); });
     std::unique_lock<std::mutex> lock{mutex_};
-    wait_get_.wait(lock, [&] { return !IsEmpty() || closed_; });
+    WaitGet(lock);
+    if (IsEmpty()) {
+      return false;
+    }
+    PopItem(lock, item);
+    return true;
+  }
 
+  // never blocks; returns false iff queue is full, item is left untouched
+  // in that case; throws QueueClosed exception after Close
+  bool TryPut(T& item) {
+    std::unique_lock<std::mutex> lock{mutex_};
+    if (closed_) {
+      throw tpcc::solutions::QueueClosed();
+    }
+    if (IsFull()) {
+      return false;
+    }
+    PushItem(lock, std::move(item));
+    return true;
+  }
+
+  // never blocks; returns false iff queue is empty
+  bool TryGet(T& item) {
+    std::unique_lock<std::mutex> lock{mutex_};
     if (IsEmpty()) {
       return false;
-    } else {
-      item = std::move(items_.front());
+    }
+    PopItem(lock, item);
+    return true;
+  }
+
+  // returns false iff queue is still full at deadline, item is left
+  // untouched in that case; throws QueueClosed exception after Close
+  template <class Clock, class Duration>
+  bool TryPutUntil(T& item,
+                   const std::chrono::time_point<Clock, Duration>& deadline) {
+    std::unique_lock<std::mutex> lock{mutex_};
+    if (!WaitUntil(lock, wait_put_, putters_waiting_,
+                   [&] { return !IsFull() || closed_; }, deadline)) {
+      return false;
+    }
+    if (closed_) {
+      throw tpcc::solutions::QueueClosed();
+    }
+    PushItem(lock, std::move(item));
+    return true;
+  }
+
+  // returns false iff queue is still empty at deadline or empty and closed
+  template <class Clock, class Duration>
+  bool TryGetUntil(T& item,
+                   const std::chrono::time_point<Clock, Duration>& deadline) {
+    std::unique_lock<std::mutex> lock{mutex_};
+    if (!WaitUntil(lock, wait_get_, getters_waiting_,
+                   [&] { return !IsEmpty() || closed_; }, deadline) ||
+        IsEmpty()) {
+      return false;
+    }
+    PopItem(lock, item);
+    return true;
+  }
+
+  // moves up to std::distance(begin, end) items into the queue
+  // under a single lock acquisition, waits only while queue is full;
+  // returns number of items moved, throws QueueClosed exception after Close
+  template <class InputIterator>
+  size_t PutMany(InputIterator begin, InputIterator end) {
+    if (begin == end) {
+      return 0;
+    }
+    SpinWhile([&] { return LooksFull(); });
+    std::unique_lock<std::mutex> lock{mutex_};
+    WaitPut(lock);
+    if (closed_) {
+      throw tpcc::solutions::QueueClosed();
+    }
+    size_t moved = 0;
+    for (; begin != end && !IsFull(); ++begin, ++moved) {
+      items_.push_back(std::move(*begin));
+    }
+    size_.store(items_.size());
+    NotifyBatch(lock, wait_get_, getters_waiting_, moved);
+    return moved;
+  }
+
+  // moves up to max_count items to out under a single lock acquisition,
+  // waits only while queue is empty;
+  // returns number of items moved, 0 iff queue is empty and closed
+  template <class OutputIterator>
+  size_t GetMany(OutputIterator out, const size_t max_count) {
+    if (max_count == 0) {
+      return 0;
+    }
+    SpinWhile([&] { return LooksEmpty(); });
+    std::unique_lock<std::mutex> lock{mutex_};
+    WaitGet(lock);
+    size_t moved = 0;
+    for (; moved < max_count && !IsEmpty(); ++moved) {
+      *out++ = std::move(items_.front());
       items_.pop_front();
-      lock.unlock();
-      wait_put_.notify_one();
-      return true;
     }
+    size_.store(items_.size());
+    NotifyBatch(lock, wait_put_, putters_waiting_, moved);
+    return moved;
   }
 
   // close queue for Puts
   void Close() {
     std::unique_lock<std::mutex> lock{mutex_};
     closed_ = true;
+    closed_hint_.store(true);
     lock.unlock();
     wait_put_.notify_all();
     wait_get_.notify_all();
@@ -73,6 +178,125 @@ class BlockingQueue {
     return items_.empty();
   }
 
+  // lock-free approximations of the predicates above, used for spinning
+
+  bool LooksFull() const {
+    return capacity_ != 0 && size_.load() >= capacity_ && !closed_hint_.load();
+  }
+
+  bool LooksEmpty() const {
+    return size_.load() == 0 && !closed_hint_.load();
+  }
+
+  // The shared limit is written only when there actually was a wait:
+  // doubled if spinning ended it, halved if it did not, and only if the
+  // value changes
+  template <class Predicate>
+  void SpinWhile(Predicate condition) {
+    if (!condition()) {
+      return void();
+    }
+    const size_t spin_limit = spin_limit_.load();
+    for (size_t i = 1; i < spin_limit; ++i) {
+      CpuRelax();
+      if (!condition()) {
+        contention::Count(contention::kSpinIterations, i);
+        UpdateSpinLimit(spin_limit, spin_limit * 2 < kMaxSpins
+                                        ? spin_limit * 2
+                                        : size_t{kMaxSpins});
+        return void();
+      }
+    }
+    contention::Count(contention::kSpinIterations, spin_limit);
+    UpdateSpinLimit(spin_limit, spin_limit / 2 > kMinSpins
+                                    ? spin_limit / 2
+                                    : size_t{kMinSpins});
+  }
+
+  void UpdateSpinLimit(const size_t current, const size_t updated) {
+    if (current != updated) {
+      spin_limit_.store(updated);
+    }
+  }
+
+  static void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+  }
+
+  void WaitPut(std::unique_lock<std::mutex>& lock) {
+    WaitWhile(lock, wait_put_, putters_waiting_,
+              [&] { return IsFull() && !closed_; });
+  }
+
+  void WaitGet(std::unique_lock<std::mutex>& lock) {
+    WaitWhile(lock, wait_get_, getters_waiting_,
+              [&] { return IsEmpty() && !closed_; });
+  }
+
+  template <class Predicate>
+  static void WaitWhile(std::unique_lock<std::mutex>& lock,
+                        tpcc::condition_variable& waiters,
+                        size_t& waiters_count, Predicate condition) {
+    while (condition()) {
+      ++waiters_count;
+      contention::WaitTimer wait_timer_;
+      waiters.wait(lock);
+      --waiters_count;
+    }
+  }
+
+  // returns ready() at exit
+  template <class Predicate, class Clock, class Duration>
+  static bool WaitUntil(
+      std::unique_lock<std::mutex>& lock, tpcc::condition_variable& waiters,
+      size_t& waiters_count, Predicate ready,
+      const std::chrono::time_point<Clock, Duration>& deadline) {
+    while (!ready()) {
+      ++waiters_count;
+      contention::WaitTimer wait_timer_;
+      auto status = waiters.wait_until(lock, deadline);
+      --waiters_count;
+      if (status == std::cv_status::timeout) {
+        return ready();
+      }
+    }
+    return true;
+  }
+
+  void PushItem(std::unique_lock<std::mutex>& lock, T item) {
+    items_.push_back(std::move(item));
+    size_.store(items_.size());
+    NotifyBatch(lock, wait_get_, getters_waiting_, 1);
+  }
+
+  void PopItem(std::unique_lock<std::mutex>& lock, T& item) {
+    item = std::move(items_.front());
+    items_.pop_front();
+    size_.store(items_.size());
+    NotifyBatch(lock, wait_put_, putters_waiting_, 1);
+  }
+
+  // one notification per batch, none if nobody waits; releases lock
+  static void NotifyBatch(std::unique_lock<std::mutex>& lock,
+                          tpcc::condition_variable& waiters,
+                          const size_t waiters_count,
+                          const size_t batch_size) {
+    lock.unlock();
+    if (waiters_count == 0) {
+      return void();
+    }
+    contention::Count(contention::kUnparks);
+    if (batch_size == 1) {
+      waiters.notify_one();
+    } else if (batch_size > 1) {
+      waiters.notify_all();
+    }
+  }
+
  private:
   size_t capacity_;
   Container items_;
@@ -80,6 +304,12 @@ class BlockingQueue {
   std::mutex mutex_;
   tpcc::condition_variable wait_put_;
   tpcc::condition_variable wait_get_;
+  size_t putters_waiting_{0};
+  size_t getters_waiting_{0};
+  // mirrors of items_.size() and closed_ for spinning without mutex_
+  tpcc::atomic<size_t> size_{0};
+  tpcc::atomic<bool> closed_hint_{false};
+  tpcc::atomic<size_t> spin_limit_{kMinSpins};
 };
 
 }  // namespace solutions
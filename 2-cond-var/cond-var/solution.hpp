@@ -1,12 +1,129 @@
 #pragma once
 
+#include "contention.hpp"
+
 #include <tpcc/concurrency/futex.hpp>
  
 #include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <type_traits>
+#include <utility>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
 
 namespace tpcc {
 namespace solutions {
 
+// tpcc::Futex with the operations condition variables need on top of
+// wait and wake: a timed wait and requeueing onto another futex word
+
+class Futex : public tpcc::Futex {
+ public:
+  explicit Futex(std::atomic<uint32_t>& word)
+      : tpcc::Futex(word), word_(word) {
+  }
+
+  // returns false on timeout
+  bool WaitFor(const uint32_t expected, std::chrono::nanoseconds timeout) {
+    if (timeout <= std::chrono::nanoseconds::zero()) {
+      return false;
+    }
+    auto seconds_ = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+    struct timespec relative_;
+    relative_.tv_sec = seconds_.count();
+    relative_.tv_nsec = (timeout - seconds_).count();
+    long result_ = syscall(SYS_futex, GetAddress(word_), FUTEX_WAIT_PRIVATE,
+                           expected, &relative_, nullptr, 0);
+    return !(result_ == -1 && errno == ETIMEDOUT);
+  }
+
+  // wakes one waiter and moves the rest to target, fails with EAGAIN if
+  // the word no longer holds expected
+  bool WakeOneRequeueRest(const uint32_t expected,
+                          std::atomic<uint32_t>& target) {
+    return syscall(SYS_futex, GetAddress(word_), FUTEX_CMP_REQUEUE_PRIVATE, 1,
+                   INT_MAX, GetAddress(target), expected) != -1;
+  }
+
+ private:
+  static uint32_t* GetAddress(std::atomic<uint32_t>& word) {
+    return reinterpret_cast<uint32_t*>(&word);
+  }
+
+ private:
+  std::atomic<uint32_t>& word_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Mutex supports wait morphing if it exposes its futex word and a lock
+// path that leaves the word in the "contended" state, so that unlock
+// wakes the next thread requeued onto the word
+
+template <class Mutex, class = void>
+struct SupportsWaitMorphing : std::false_type {};
+
+template <class Mutex>
+struct SupportsWaitMorphing<
+    Mutex, decltype(void(std::declval<Mutex&>().GetFutexWord()),
+                    void(std::declval<Mutex&>().LockContended()))>
+    : std::true_type {};
+
+// Three-state futex mutex (0 - free, 1 - locked, 2 - locked with waiters)
+// which supports wait morphing
+class FutexMutex {
+ public:
+  FutexMutex() : futex_(state_) {
+  }
+
+  void lock() {
+    uint32_t free_ = 0;
+    if (!state_.compare_exchange_strong(free_, 1)) {
+      LockContended();
+    }
+  }
+
+  bool try_lock() {
+    uint32_t free_ = 0;
+    return state_.compare_exchange_strong(free_, 1);
+  }
+
+  void unlock() {
+    if (state_.exchange(0) == 2) {
+      contention::Count(contention::kUnparks);
+      futex_.WakeOne();
+    }
+  }
+
+  void LockContended() {
+    while (state_.exchange(2) != 0) {
+      contention::WaitTimer wait_timer_;
+      futex_.Wait(2);
+    }
+  }
+
+  std::atomic<uint32_t>& GetFutexWord() {
+    return state_;
+  }
+
+ private:
+  std::atomic<uint32_t> state_{0};
+  tpcc::Futex futex_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+// NotifyAll wakes a single waiter and requeues the rest onto the futex
+// word of their mutex, so they are released one by one by unlocks
+// instead of all waking up to fight for the mutex. With mutexes that
+// don't support wait morphing NotifyAll falls back to waking everyone
+
 class ConditionVariable {
  public:
   ConditionVariable() : futex_(signal_count_) {
@@ -14,25 +131,111 @@ class ConditionVariable {
 
   template <class Mutex>
   void Wait(Mutex& mutex) {
-    uint32_t this_thread_index_ = signal_count_.load();
+    uint32_t this_thread_index_ = PrepareWait(mutex);
     mutex.unlock();
-    futex_.Wait(this_thread_index_);
-    mutex.lock();
+    {
+      contention::WaitTimer wait_timer_;
+      futex_.Wait(this_thread_index_);
+    }
+    FinishWait(mutex);
+  }
+
+  template <class Mutex, class Clock, class Duration>
+  std::cv_status WaitUntil(
+      Mutex& mutex,
+      const std::chrono::time_point<Clock, Duration>& deadline) {
+    uint32_t this_thread_index_ = PrepareWait(mutex);
+    mutex.unlock();
+    bool notified_;
+    {
+      contention::WaitTimer wait_timer_;
+      notified_ = futex_.WaitFor(
+          this_thread_index_,
+          std::chrono::duration_cast<std::chrono::nanoseconds>(deadline -
+                                                               Clock::now()));
+    }
+    // a requeued waiter keeps its deadline while it waits for the mutex,
+    // so a notify is told by the signal count rather than by the futex
+    notified_ = notified_ || signal_count_.load() != this_thread_index_;
+    FinishWait(mutex);
+    return notified_ ? std::cv_status::no_timeout : std::cv_status::timeout;
+  }
+
+  template <class Mutex, class Rep, class Period>
+  std::cv_status WaitFor(Mutex& mutex,
+                         const std::chrono::duration<Rep, Period>& timeout) {
+    return WaitUntil(mutex, std::chrono::steady_clock::now() + timeout);
   }
 
   void NotifyOne() {
     ++signal_count_;
-    futex_.WakeOne();
+    if (waiters_count_.load() > 0) {
+      contention::Count(contention::kUnparks);
+      futex_.WakeOne();
+    }
   }
 
   void NotifyAll() {
-    ++signal_count_;
-    futex_.WakeAll();
+    uint32_t signal_ = ++signal_count_;
+    if (waiters_count_.load() == 0) {
+      return void();
+    }
+    contention::Count(contention::kUnparks);
+    std::atomic<uint32_t>* target_ = morph_target_.load();
+    // a concurrent notify changed the word, let everyone go
+    if (target_ == nullptr ||
+        !futex_.WakeOneRequeueRest(signal_, *target_)) {
+      futex_.WakeAll();
+    }
+  }
+
+ private:
+  template <class Mutex>
+  uint32_t PrepareWait(Mutex& mutex) {
+    ++waiters_count_;
+    RememberMutex(mutex, SupportsWaitMorphing<Mutex>{});
+    return signal_count_.load();
+  }
+
+  // the last waiter to leave forgets the mutex, which may die after it
+  template <class Mutex>
+  void FinishWait(Mutex& mutex) {
+    std::atomic<uint32_t>* target_ = morph_target_.load();
+    if (--waiters_count_ == 0) {
+      morph_target_.compare_exchange_strong(target_, nullptr);
+    }
+    Relock(mutex, SupportsWaitMorphing<Mutex>{});
+  }
+
+  // refreshed by every wait
+  template <class Mutex>
+  void RememberMutex(Mutex& mutex, std::true_type) {
+    morph_target_.store(&mutex.GetFutexWord());
+  }
+
+  template <class Mutex>
+  void RememberMutex(Mutex& /*mutex*/, std::false_type) {
+    morph_target_.store(nullptr);
+  }
+
+  // we may have been requeued behind other waiters, so the mutex
+  // must stay marked as contended
+  template <class Mutex>
+  void Relock(Mutex& mutex, std::true_type) {
+    mutex.LockContended();
+  }
+
+  template <class Mutex>
+  void Relock(Mutex& mutex, std::false_type) {
+    mutex.lock();
   }
 
  private:
   std::atomic<uint32_t> signal_count_{0};
-  tpcc::Futex futex_;
+  std::atomic<uint32_t> waiters_count_{0};
+  // futex word of the mutex waiters are using, if it supports morphing
+  std::atomic<std::atomic<uint32_t>*> morph_target_{nullptr};
+  Futex futex_;
 };
 
 }  // namespace solutions
@@ -1,40 +1,194 @@
 #pragma once
 
-#include <tpcc/stdlike/condition_variable.hpp>
+#include "contention.hpp"
 
+#include <tpcc/concurrency/futex.hpp>
+
+#include <cassert>
 #include <cstddef>
-#include <mutex>
+#include <cstdint>
+#include <cstdlib>
 #include <atomic>
+#include <memory>
+#include <new>
 
 namespace tpcc {
 namespace solutions {
 
+// Combining-tree barrier. Arrivals are spread over leaves of kFanIn
+// threads, and only the last thread to arrive at a node climbs to its
+// parent, so no counter is touched by more than kFanIn threads. The
+// last arrival at the root flips the phase, whose parity plays the role
+// of the sense. Waiters spin on the phase for a while, then park on it.
+//
+// Arrive() + Wait(token) split PassThrough() in two, so a thread can do
+// independent work in between. A thread must Wait for its token before
+// arriving again. num_threads must be positive
+
 class CyclicBarrier {
+  static const size_t kFanIn = 4;
+  static const size_t kSpinIterations = 1024;
+  static const size_t kNoParent = SIZE_MAX;
+
+  // counts arrivals modulo 2^32:
+  // phase p owns [p * capacity, (p + 1) * capacity)
+  struct alignas(64) Node {
+    std::atomic<uint32_t> arrivals_{0};
+    uint32_t capacity_{0};
+    size_t parent_{kNoParent};
+  };
+
+  // plain new and std::allocator don't honour extended alignment before
+  // C++17, so the nodes come from posix_memalign
+  struct NodesDeleter {
+    size_t count_;
+
+    void operator()(Node* nodes) const {
+      for (size_t i = 0; i < count_; ++i) {
+        nodes[i].~Node();
+      }
+      std::free(nodes);
+    }
+  };
+
+  using NodeArray = std::unique_ptr<Node[], NodesDeleter>;
+
  public:
+  using Token = uint32_t;
+
   explicit CyclicBarrier(const size_t num_threads)
-      : threads_(num_threads), thread_necessary_to_pas_(num_threads) {
+      : nodes_(NewNodes(CountNodes(num_threads))), futex_(phase_) {
+    assert(num_threads > 0);
+    // leaves have kFanIn slots each, the last one takes the rest, so
+    // the slots add up to exactly num_threads
+    size_t level_begin_ = 0;
+    size_t level_size_ = 0;
+    for (size_t left_ = num_threads; left_ > 0; ++level_size_) {
+      size_t slots_ = left_ < kFanIn ? left_ : size_t{kFanIn};
+      nodes_[level_size_].capacity_ = static_cast<uint32_t>(slots_);
+      left_ -= slots_;
+    }
+    leaves_count_ = level_size_;
+
+    size_t next_free_ = level_size_;
+    while (level_size_ > 1) {
+      const size_t parents_begin_ = next_free_;
+      for (size_t child_ = 0; child_ < level_size_; ++child_) {
+        const size_t parent_ = parents_begin_ + child_ / kFanIn;
+        nodes_[level_begin_ + child_].parent_ = parent_;
+        ++nodes_[parent_].capacity_;
+      }
+      next_free_ = parents_begin_ + (level_size_ + kFanIn - 1) / kFanIn;
+      level_begin_ = parents_begin_;
+      level_size_ = next_free_ - parents_begin_;
+    }
   }
 
   void PassThrough() {
-    std::unique_lock<std::mutex> lock{mutex_};
-    --thread_necessary_to_pas_;
-    if (thread_necessary_to_pas_ == 0) {
-      ++cycles_;
-      all_threads_arrived_.notify_all();
-      thread_necessary_to_pas_ = threads_;
-    } else {
-      size_t cycle_of_this_thread_ = cycles_;
-      all_threads_arrived_.wait(
-          lock, [&]() { return cycle_of_this_thread_ < cycles_; });
+    Wait(Arrive());
+  }
+
+  Token Arrive() {
+    // can't change until we arrive
+    const Token phase_now_ = phase_.load();
+
+    size_t node_;
+    bool last_ = TakeLeafSlot(phase_now_, node_);
+    while (last_ && nodes_[node_].parent_ != kNoParent) {
+      node_ = nodes_[node_].parent_;
+      last_ = ArriveAt(nodes_[node_], phase_now_);
+    }
+    if (!last_) {
+      return phase_now_;
+    }
+    // last thread of the phase
+    phase_.store(phase_now_ + 1);
+    if (sleepers_.load() > 0) {
+      contention::Count(contention::kUnparks);
+      futex_.WakeAll();
+    }
+    return phase_now_;
+  }
+
+  void Wait(const Token token) {
+    for (size_t i = 0; i < kSpinIterations; ++i) {
+      if (phase_.load() != token) {
+        contention::Count(contention::kSpinIterations, i);
+        return void();
+      }
+      Pause();
+    }
+    contention::Count(contention::kSpinIterations, kSpinIterations);
+    ++sleepers_;
+    while (phase_.load() == token) {
+      contention::WaitTimer wait_timer_;
+      futex_.Wait(token);
+    }
+    --sleepers_;
+  }
+
+ private:
+  static NodeArray NewNodes(const size_t count) {
+    void* memory_ = nullptr;
+    if (posix_memalign(&memory_, alignof(Node), count * sizeof(Node)) != 0) {
+      throw std::bad_alloc();
+    }
+    Node* nodes_ = static_cast<Node*>(memory_);
+    for (size_t i = 0; i < count; ++i) {
+      new (nodes_ + i) Node{};
+    }
+    return NodeArray{nodes_, NodesDeleter{count}};
+  }
+
+  static size_t CountNodes(size_t num_threads) {
+    size_t total_ = 0;
+    size_t level_size_ = (num_threads + kFanIn - 1) / kFanIn;
+    while (level_size_ > 1) {
+      total_ += level_size_;
+      level_size_ = (level_size_ + kFanIn - 1) / kFanIn;
     }
+    return total_ + 1;
+  }
+
+  // returns true if we were the last to arrive at the node in this phase
+  bool ArriveAt(Node& node, const Token phase) {
+    uint32_t arrived_before_ =
+        node.arrivals_.fetch_add(1) - phase * node.capacity_;
+    return arrived_before_ + 1 == node.capacity_;
+  }
+
+  // Starts from the leaf this thread used last time. A full leaf is
+  // skipped without touching its counter, so arrivals never spill into
+  // the next phase. Returns true if we filled the leaf
+  bool TakeLeafSlot(const Token phase, size_t& leaf) {
+    static thread_local size_t preferred_leaf_ = 0;
+    size_t leaf_ = preferred_leaf_ % leaves_count_;
+    while (true) {
+      Node& node_ = nodes_[leaf_];
+      uint32_t arrivals_ = node_.arrivals_.load();
+      while (arrivals_ - phase * node_.capacity_ < node_.capacity_) {
+        if (node_.arrivals_.compare_exchange_weak(arrivals_, arrivals_ + 1)) {
+          preferred_leaf_ = leaf = leaf_;
+          return arrivals_ + 1 - phase * node_.capacity_ == node_.capacity_;
+        }
+        contention::Count(contention::kCasRetries);
+      }
+      leaf_ = (leaf_ + 1) % leaves_count_;
+    }
+  }
+
+  static void Pause() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
   }
 
  private:
-  std::mutex mutex_;
-  std::condition_variable all_threads_arrived_;
-  size_t thread_necessary_to_pas_;
-  size_t cycles_{0};
-  const size_t threads_;
+  NodeArray nodes_;
+  size_t leaves_count_{0};
+  alignas(64) std::atomic<uint32_t> phase_{0};
+  std::atomic<uint32_t> sleepers_{0};
+  tpcc::Futex futex_;
 };
 
 }  // namespace solutions
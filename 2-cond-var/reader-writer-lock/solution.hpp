@@ -2,81 +2,148 @@
 
 #include <rwlock_traits.hpp>
 
-#include <tpcc/stdlike/condition_variable.hpp>
+#include "contention.hpp"
 
-#include <mutex>
+#include <tpcc/concurrency/futex.hpp>
+
+#include <atomic>
+#include <cstdint>
 
 namespace tpcc {
 namespace solutions {
 
+// Phase-fair lock: reader and writer phases alternate. Readers that
+// arrive while a writer holds or waits for the lock are parked and all
+// admitted together when that writer leaves, even if more writers are
+// waiting; a writer waits only for the readers admitted before it.
+//
+// All the state is in one 64-bit word, so uncontended ReaderLock and
+// WriterLock are a single CAS each:
+//   bit 0       - writer holds or drains the lock
+//   bit 1       - phase, flipped by every WriterUnlock
+//   bits 2..31  - readers parked until the end of the current writer phase
+//   bits 32..63 - readers inside the critical section
+// Parked readers, the writer waiting for readers to drain and writers
+// waiting for their turn sleep on three separate futex words
+
 class ReaderWriterLock {
+  static const uint64_t kWriter = 1;
+  static const uint64_t kPhase = 2;
+  static const uint64_t kParkedReader = 4;
+  static const uint64_t kParkedReadersMask = 0xFFFFFFFCull;
+  static const uint64_t kActiveReader = uint64_t{1} << 32;
+
  public:
+  ReaderWriterLock()
+      : reader_phase_futex_(reader_phase_),
+        drained_futex_(drained_),
+        writer_turn_futex_(writer_turn_) {
+  }
+
   // reader section / shared ownership
 
-  void WriterLock() {
-    std::unique_lock<std::mutex> u_lock{mutex_};
-    if (bunch_ == 0) {
-      ++bunch_;
-      bunch_type_ = true;
+  void ReaderLock() {
+    // enter, or park until the end of the writer phase
+    uint64_t state_now_ = state_.load();
+    while (true) {
+      const uint64_t increment_ =
+          (state_now_ & kWriter) == 0 ? kActiveReader : kParkedReader;
+      if (state_.compare_exchange_weak(state_now_, state_now_ + increment_)) {
+        if (increment_ == kActiveReader) {
+          return void();
+        }
+        break;
+      }
+      contention::Count(contention::kCasRetries);
     }
-    if (bunch_type_ == false) {
-      ++bunch_;
+    const uint64_t phase_ = state_now_ & kPhase;
+    while (true) {
+      uint32_t reader_phase_now_ = reader_phase_.load();
+      if ((state_.load() & kPhase) != phase_) {
+        return void();
+      }
+      contention::WaitTimer wait_timer_;
+      reader_phase_futex_.Wait(reader_phase_now_);
     }
-    bunch_type_ = true;
-    size_t this_bunch_ = bunch_++;
-    size_t prev_bunch_size_ = bunch_size_;
-    bunch_size_ = 0;
-    threads_wait_token_.wait(u_lock, [&] {
-      return (this_bunch_ == current_bunch_) &&
-             (served_writers_ == prev_bunch_size_);
-    });
-    served_writers_ = 0;
   }
 
-  void WriterUnlock() {
-    std::unique_lock<std::mutex> u_lock{mutex_};
-    ++current_bunch_;
-    threads_wait_token_.notify_all();
+  void ReaderUnlock() {
+    uint64_t state_before_ = state_.fetch_sub(kActiveReader);
+    if ((state_before_ & kWriter) != 0 &&
+        (state_before_ >> 32) == 1) {
+      ++drained_;
+      contention::Count(contention::kUnparks);
+      drained_futex_.WakeOne();
+    }
   }
 
   // writer section / exclusive ownership
 
-  void ReaderLock() {
-    std::unique_lock<std::mutex> u_lock{mutex_};
-    if (bunch_ == 0) {
-      ++bunch_;
-      bunch_type_ = false;
+  void WriterLock() {
+    uint64_t state_now_ = state_.load();
+    while (true) {
+      if ((state_now_ & kWriter) == 0) {
+        if (state_.compare_exchange_weak(state_now_, state_now_ | kWriter)) {
+          break;
+        }
+        contention::Count(contention::kCasRetries);
+        continue;
+      }
+      uint32_t writer_turn_now_ = writer_turn_.load();
+      ++waiting_writers_;
+      if ((state_.load() & kWriter) != 0) {
+        contention::WaitTimer wait_timer_;
+        writer_turn_futex_.Wait(writer_turn_now_);
+      }
+      --waiting_writers_;
+      state_now_ = state_.load();
     }
-    if (bunch_type_ == true) {
-      bunch_type_ = false;
-      bunch_size_ = 0;
+
+    // wait for the readers of the previous phase
+    while (true) {
+      uint32_t drained_now_ = drained_.load();
+      if ((state_.load() >> 32) == 0) {
+        return void();
+      }
+      contention::WaitTimer wait_timer_;
+      drained_futex_.Wait(drained_now_);
     }
-    size_t this_bunch_ = bunch_;
-    ++bunch_size_;
-    threads_wait_token_.wait(u_lock,
-                             [&] { return this_bunch_ <= current_bunch_; });
-    current_bunch_ = this_bunch_ + 1;
-    ++writers_in_critical_section_;
   }
 
-  void ReaderUnlock() {
-    std::unique_lock<std::mutex> u_lock{mutex_};
-    --writers_in_critical_section_;
-    ++served_writers_;
-    if (writers_in_critical_section_ == 0) {
-      threads_wait_token_.notify_all();
+  void WriterUnlock() {
+    uint64_t state_now_ = state_.load();
+    uint64_t parked_readers_;
+    while (true) {
+      parked_readers_ = (state_now_ & kParkedReadersMask) / kParkedReader;
+      uint64_t next_state_ = ((state_now_ & ~kWriter) ^ kPhase) &
+                             ~kParkedReadersMask;
+      next_state_ += parked_readers_ * kActiveReader;
+      if (state_.compare_exchange_weak(state_now_, next_state_)) {
+        break;
+      }
+      contention::Count(contention::kCasRetries);
+    }
+    if (parked_readers_ > 0) {
+      ++reader_phase_;
+      contention::Count(contention::kUnparks);
+      reader_phase_futex_.WakeAll();
+    }
+    if (waiting_writers_.load() > 0) {
+      ++writer_turn_;
+      contention::Count(contention::kUnparks);
+      writer_turn_futex_.WakeOne();
     }
   }
 
  private:
-  size_t current_bunch_{1};
-  size_t bunch_{0};
-  size_t bunch_size_{0};
-  size_t served_writers_{0};
-  size_t writers_in_critical_section_{0};
-  bool bunch_type_ = true;  // true = reader, false = writer
-  tpcc::condition_variable threads_wait_token_;
-  std::mutex mutex_;
+  std::atomic<uint64_t> state_{0};
+  std::atomic<uint32_t> reader_phase_{0};
+  std::atomic<uint32_t> drained_{0};
+  std::atomic<uint32_t> writer_turn_{0};
+  std::atomic<uint32_t> waiting_writers_{0};
+  tpcc::Futex reader_phase_futex_;
+  tpcc::Futex drained_futex_;
+  tpcc::Futex writer_turn_futex_;
 };
 
 template <>
@@ -85,4 +152,4 @@ struct RWLockTraits<ReaderWriterLock> {
 };
 
 }  // namespace solutions
-}
\ No newline at end of file
+}
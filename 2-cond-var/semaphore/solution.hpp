@@ -1,35 +1,157 @@
 #pragma once
 
+#include "contention.hpp"
+
 #include <tpcc/stdlike/condition_variable.hpp>
 #include <mutex>
 #include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
 
 namespace tpcc {
 namespace solutions {
 
+// Permits are taken and returned with a single RMW on free_tokens_.
+// mutex_ and has_tokens_ are touched only when a thread has to sleep
+// or when somebody sleeps
+//
+// While a bulk waiter (count > 1) is queued, single-permit acquirers
+// don't take permits, neither on the fast path nor after waking, so
+// that a stream of them can't starve it. They are woken when the last
+// bulk waiter leaves
+//
+// A bulk acquisition can't ask for more than the capacity: it would wait
+// forever and hold single-permit acquirers back meanwhile. AcquireMany
+// treats that as a precondition violation, TryAcquire and TryAcquireFor
+// fail at once. A single permit may always be asked for, so a semaphore
+// of capacity 0 still works as a signal
+
 class Semaphore {
  public:
-  explicit Semaphore(const size_t capacity = 0) : capacity_(capacity) {
+  explicit Semaphore(const size_t capacity = 0)
+      : capacity_(capacity), free_tokens_(capacity) {
   }
 
   void Acquire() {
+    AcquireMany(1);
+  }
+
+  void Release() {
+    ReleaseMany(1);
+  }
+
+  bool TryAcquire(const size_t count = 1) {
+    if (count == 1 && bulk_waiters_.load() > 0) {
+      return false;
+    }
+    return CanEverFit(count) && TryTake(count);
+  }
+
+  void AcquireMany(const size_t count) {
+    assert(CanEverFit(count) && "bulk acquisition exceeds the capacity");
+    if (TryAcquire(count)) {
+      return void();
+    }
     std::unique_lock<std::mutex> u_lock{mutex_};
-    while (current_tokens_.load() == capacity_) {
+    WaiterGuard waiter_{*this, count};
+    while (!TryAcquire(count)) {
+      contention::WaitTimer wait_timer_;
       has_tokens_.wait(u_lock);
     }
-    ++current_tokens_;
   }
 
-  void Release() {
+  template <class Rep, class Period>
+  bool TryAcquireFor(const std::chrono::duration<Rep, Period>& timeout,
+                     const size_t count = 1) {
+    if (!CanEverFit(count)) {
+      return false;
+    }
+    if (TryAcquire(count)) {
+      return true;
+    }
+    const auto deadline_ = std::chrono::steady_clock::now() + timeout;
     std::unique_lock<std::mutex> u_lock{mutex_};
-    --current_tokens_;
-    has_tokens_.notify_one();
+    WaiterGuard waiter_{*this, count};
+    while (!TryAcquire(count)) {
+      contention::WaitTimer wait_timer_;
+      if (has_tokens_.wait_until(u_lock, deadline_) ==
+          std::cv_status::timeout) {
+        return TryAcquire(count);
+      }
+    }
+    return true;
+  }
+
+  void ReleaseMany(const size_t count) {
+    free_tokens_.fetch_add(count);
+    if (waiters_.load() == 0) {
+      return void();
+    }
+    // waiters check free_tokens_ under the mutex before sleeping, so
+    // passing through it is enough not to lose the wake-up
+    { std::unique_lock<std::mutex> u_lock{mutex_}; }
+    contention::Count(contention::kUnparks);
+    // a woken bulk waiter may still not fit, so wake everyone then
+    if (count == 1 && bulk_waiters_.load() == 0) {
+      has_tokens_.notify_one();
+    } else {
+      has_tokens_.notify_all();
+    }
+  }
+
+  size_t GetCapacity() const {
+    return capacity_;
+  }
+
+ private:
+  bool CanEverFit(const size_t count) const {
+    return count <= 1 || count <= capacity_;
   }
 
+  bool TryTake(const size_t count) {
+    size_t free_tokens_now_ = free_tokens_.load();
+    while (free_tokens_now_ >= count) {
+      if (free_tokens_.compare_exchange_weak(free_tokens_now_,
+                                             free_tokens_now_ - count)) {
+        return true;
+      }
+      contention::Count(contention::kCasRetries);
+    }
+    return false;
+  }
+
+  // constructed and destroyed under mutex_
+  class WaiterGuard {
+   public:
+    WaiterGuard(Semaphore& semaphore, const size_t count)
+        : semaphore_(semaphore), bulk_(count > 1) {
+      ++semaphore_.waiters_;
+      if (bulk_) {
+        ++semaphore_.bulk_waiters_;
+      }
+    }
+
+    ~WaiterGuard() {
+      if (bulk_ && --semaphore_.bulk_waiters_ == 0 &&
+          semaphore_.free_tokens_.load() > 0) {
+        // single-permit waiters held back for the bulk ones
+        semaphore_.has_tokens_.notify_all();
+      }
+      --semaphore_.waiters_;
+    }
+
+   private:
+    Semaphore& semaphore_;
+    const bool bulk_;
+  };
+
  private:
   std::mutex mutex_;
   const std::size_t capacity_;
-  std::atomic<std::size_t> current_tokens_{0};
+  std::atomic<std::size_t> free_tokens_;
+  std::atomic<std::size_t> waiters_{0};
+  std::atomic<std::size_t> bulk_waiters_{0};
   tpcc::condition_variable has_tokens_;
 };
 
@@ -0,0 +1,187 @@
+#pragma once
+
+// Every task directory has its own copy of this file, so that tasks
+// don't depend on each other. When several tasks are used together, the
+// first copy included defines the counters and the others only check
+// that they are of the same revision. Bump the revision in every copy
+// whenever the definitions change
+
+#if defined(TPCC_SOLUTIONS_CONTENTION_REVISION)
+#if TPCC_SOLUTIONS_CONTENTION_REVISION != 1
+#error "contention.hpp copies of different revisions are included together"
+#endif
+#else
+#define TPCC_SOLUTIONS_CONTENTION_REVISION 1
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(TPCC_CONTENTION_STATS)
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#endif
+
+namespace tpcc {
+namespace solutions {
+namespace contention {
+
+// Contention counters shared by all primitives. They are compiled in
+// only with -DTPCC_CONTENTION_STATS; otherwise Count and WaitTimer are
+// empty and vanish after inlining.
+//
+// Every thread increments its own cache-line-sized block, so counting
+// never causes coherence traffic. TakeSnapshot sums the blocks of live
+// threads and the totals left by exited ones
+
+enum Counter : size_t {
+  kCasRetries = 0,         // failed CAS in a retry loop
+  kSpinIterations = 1,     // busy-wait / backoff iterations
+  kParks = 2,              // futex or condition variable sleeps
+  kUnparks = 3,            // wake-ups issued
+  kWaitNanoseconds = 4,    // time spent parked
+  kValidationRetries = 5,  // optimistic reads or validations redone
+  kCounterCount = 6
+};
+
+struct Snapshot {
+  uint64_t Get(const Counter counter) const {
+    return values_[counter];
+  }
+
+  std::array<uint64_t, kCounterCount> values_{};
+};
+
+#if defined(TPCC_CONTENTION_STATS)
+
+class Registry {
+  struct alignas(64) ThreadCounters {
+    std::array<std::atomic<uint64_t>, kCounterCount> values_{};
+  };
+
+  // registers the thread's block on first use, folds it into the
+  // registry totals at thread exit
+  class ThreadSlot {
+   public:
+    ThreadSlot() : registry_(Registry::Instance()) {
+      registry_.Attach(&counters_);
+    }
+
+    ~ThreadSlot() {
+      registry_.Detach(&counters_);
+    }
+
+    ThreadCounters& GetCounters() {
+      return counters_;
+    }
+
+   private:
+    Registry& registry_;
+    ThreadCounters counters_;
+  };
+
+ public:
+  // never destroyed: thread_local slots of threads that exit during
+  // static destruction still detach from it
+  static Registry& Instance() {
+    static Registry* registry_ = new Registry;
+    return *registry_;
+  }
+
+  // only the owning thread writes its block, no RMW needed
+  static void Add(const Counter counter, const uint64_t value) {
+    static thread_local ThreadSlot slot_;
+    std::atomic<uint64_t>& cell_ = slot_.GetCounters().values_[counter];
+    cell_.store(cell_.load(std::memory_order_relaxed) + value,
+                std::memory_order_relaxed);
+  }
+
+  Snapshot TakeSnapshot() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    Snapshot snapshot_ = exited_;
+    for (ThreadCounters* counters_ : live_) {
+      for (size_t i = 0; i < kCounterCount; ++i) {
+        snapshot_.values_[i] +=
+            counters_->values_[i].load(std::memory_order_relaxed);
+      }
+    }
+    return snapshot_;
+  }
+
+ private:
+  void Attach(ThreadCounters* counters) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    live_.push_back(counters);
+  }
+
+  void Detach(ThreadCounters* counters) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (size_t i = 0; i < kCounterCount; ++i) {
+      exited_.values_[i] +=
+          counters->values_[i].load(std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < live_.size(); ++i) {
+      if (live_[i] == counters) {
+        live_[i] = live_.back();
+        live_.pop_back();
+        break;
+      }
+    }
+  }
+
+ private:
+  std::mutex mutex_;
+  std::vector<ThreadCounters*> live_;
+  Snapshot exited_;
+};
+
+inline void Count(const Counter counter, const uint64_t value = 1) {
+  Registry::Add(counter, value);
+}
+
+inline Snapshot TakeSnapshot() {
+  return Registry::Instance().TakeSnapshot();
+}
+
+// counts a park and the time until the end of the scope
+class WaitTimer {
+ public:
+  WaitTimer() : start_(std::chrono::steady_clock::now()) {
+    Count(kParks);
+  }
+
+  ~WaitTimer() {
+    auto elapsed_ = std::chrono::steady_clock::now() - start_;
+    Count(kWaitNanoseconds,
+          std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed_)
+              .count());
+  }
+
+ private:
+  std::chrono::steady_clock::time_point start_;
+};
+
+#else
+
+inline void Count(const Counter /*counter*/, const uint64_t /*value*/ = 1) {
+}
+
+inline Snapshot TakeSnapshot() {
+  return Snapshot{};
+}
+
+class WaitTimer {
+ public:
+  WaitTimer() {
+  }
+};
+
+#endif
+
+}  // namespace contention
+}  // namespace solutions
+}  // namespace tpcc
+
+#endif
@@ -1,19 +1,33 @@
 #pragma once
 
+#include "contention.hpp"
+
 #include <tpcc/stdlike/atomic.hpp>
 #include <tpcc/stdlike/condition_variable.hpp>
 #include <tpcc/stdlike/mutex.hpp>
 
+#include <tpcc/concurrency/backoff.hpp>
 #include <tpcc/support/compiler.hpp>
 
 #include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
 #include <iostream>
 #include <forward_list>
 #include <functional>
+#include <memory>
+#include <new>
 #include <shared_mutex>
+#include <type_traits>
 #include <vector>
 #include <utility>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 namespace tpcc {
 namespace solutions {
 
@@ -28,10 +42,21 @@ class ReaderWriterLock {
     locked_by_writer_ = true;
   }
 
+  bool try_lock() {
+    std::unique_lock<std::mutex> u_lock_{mutex_};
+    if (locked_by_writer_ || locks_by_readers_ != 0) {
+      return false;
+    }
+    ++writers_;
+    locked_by_writer_ = true;
+    return true;
+  }
+
   void unlock() {
     std::unique_lock<std::mutex> u_lock_{mutex_};
     locked_by_writer_ = false;
     --writers_;
+    contention::Count(contention::kUnparks);
     thread_wait_.notify_all();
   }
 
@@ -46,6 +71,7 @@ class ReaderWriterLock {
     std::unique_lock<std::mutex> u_lock_{mutex_};
     --locks_by_readers_;
     if (locks_by_readers_ == 0) {
+      contention::Count(contention::kUnparks);
       thread_wait_.notify_all();
     }
   }
@@ -58,51 +84,701 @@ class ReaderWriterLock {
   std::mutex mutex_;
 };
 
-template <typename T, class HashFunction = std::hash<T>>
-class StripedHashSet {
+// Big-reader lock: every reader registers in one of kSlots counters,
+// picked by the thread, so readers on different cores touch different
+// cache lines. A writer raises the flag and waits until all counters drop
+// to zero, readers that see the flag step back and wait for it to clear
+
+class DistributedReaderWriterLock {
+  static const size_t kSlots = 32;
+  static const size_t kCacheLineSize = 64;
+
+  struct alignas(kCacheLineSize) ReaderSlot {
+    tpcc::atomic<size_t> readers_{0};
+  };
+
+ public:
+  DistributedReaderWriterLock() = default;
+
+  void lock() {
+    Backoff backoff{};
+    bool unlocked_ = false;
+    while (!locked_by_writer_.compare_exchange_weak(unlocked_, true)) {
+      unlocked_ = false;
+      contention::Count(contention::kCasRetries);
+      backoff();
+    }
+    for (auto& slot_ : slots_) {
+      while (slot_.readers_.load() != 0) {
+        contention::Count(contention::kSpinIterations);
+        backoff();
+      }
+    }
+  }
+
+  // fails rather than waits for readers to leave
+  bool try_lock() {
+    bool unlocked_ = false;
+    if (!locked_by_writer_.compare_exchange_strong(unlocked_, true)) {
+      return false;
+    }
+    for (auto& slot_ : slots_) {
+      if (slot_.readers_.load() != 0) {
+        locked_by_writer_.store(false);
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void unlock() {
+    locked_by_writer_.store(false);
+  }
+
+  void lock_shared() {
+    ReaderSlot& slot_ = slots_[GetThreadSlot()];
+    while (true) {
+      slot_.readers_.fetch_add(1);
+      if (!locked_by_writer_.load()) {
+        return void();
+      }
+      slot_.readers_.fetch_sub(1);
+      Backoff backoff{};
+      while (locked_by_writer_.load()) {
+        contention::Count(contention::kSpinIterations);
+        backoff();
+      }
+    }
+  }
+
+  void unlock_shared() {
+    slots_[GetThreadSlot()].readers_.fetch_sub(1);
+  }
+
  private:
-  using RWLock = ReaderWriterLock;
+  // fixed for the lifetime of a thread
+  static size_t GetThreadSlot() {
+    static tpcc::atomic<size_t> next_thread_{0};
+    static thread_local size_t slot_ = next_thread_.fetch_add(1) % kSlots;
+    return slot_;
+  }
 
+ private:
+  std::array<ReaderSlot, kSlots> slots_;
+  tpcc::atomic<bool> locked_by_writer_{false};
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Bucket storage policies for one stripe of StripedHashSet
+//
+// Insert/Remove/Contains get the stripe-local hash of the element,
+// Hasher computes the same hash from an element and is used on rehash.
+// MigrateTo moves the next max_buckets buckets to another table and
+// returns true when nothing is left to move. A table never rehashes
+// itself: NeedsRebuild tells the owner to migrate it to a new table of
+// at least GetRebuildBucketCount buckets
+
+template <typename T, class Hasher>
+class ChainedBuckets {
+  using Bucket = std::forward_list<T>;
+
+ public:
+  // removed elements are freed at once
+  static const bool kOptimisticReads = false;
+
+  ChainedBuckets(const size_t bucket_count, Hasher hasher)
+      : hasher_(hasher), buckets_(bucket_count) {
+  }
+
+  bool Insert(T element, const size_t hash) {
+    Bucket& bucket_ = GetBucket(hash);
+    if (std::find(bucket_.cbegin(), bucket_.cend(), element) != bucket_.end()) {
+      return false;
+    }
+    bucket_.push_front(std::move(element));
+    return true;
+  }
+
+  bool Remove(const T& element, const size_t hash) {
+    Bucket& bucket_ = GetBucket(hash);
+    auto remove_candidate_ =
+        std::find(bucket_.cbegin(), bucket_.cend(), element);
+    if (remove_candidate_ == bucket_.end()) {
+      return false;
+    }
+    bucket_.remove(element);
+    return true;
+  }
+
+  bool Contains(const T& element, const size_t hash) const {
+    const Bucket& bucket_ = GetBucket(hash);
+    return std::find(bucket_.cbegin(), bucket_.cend(), element) !=
+           bucket_.cend();
+  }
+
+  size_t GetBucketCount() const {
+    return buckets_.size();
+  }
+
+  // chains never run out of room
+  bool NeedsRebuild() const {
+    return false;
+  }
+
+  size_t GetRebuildBucketCount() const {
+    return buckets_.size();
+  }
+
+  bool MigrateTo(ChainedBuckets& target, const size_t max_buckets) {
+    for (size_t i = 0; i < max_buckets && migrated_ < buckets_.size();
+         ++i, ++migrated_) {
+      Bucket& bucket_ = buckets_[migrated_];
+      for (auto& element_ : bucket_) {
+        const size_t hash_ = hasher_(element_);
+        target.Insert(std::move(element_), hash_);
+      }
+      bucket_.clear();
+    }
+    return migrated_ == buckets_.size();
+  }
+
+ private:
+  Bucket& GetBucket(const size_t hash) {
+    return buckets_[hash % buckets_.size()];
+  }
+
+  const Bucket& GetBucket(const size_t hash) const {
+    return buckets_[hash % buckets_.size()];
+  }
+
+ private:
+  Hasher hasher_;
+  std::vector<Bucket> buckets_;
+  size_t migrated_{0};
+};
+
+// Slot of an open-addressing table. Where optimistic readers may look
+// at slots concurrently with a writer, the value is a relaxed atomic, so
+// the race is benign and the seqlock discards what was read
+
+template <typename T, bool kConcurrentReads>
+class SlotCell {
+ public:
+  const T& Load() const {
+    return value_;
+  }
+
+  void Store(T value) {
+    value_ = std::move(value);
+  }
+
+  T Take() {
+    return std::move(value_);
+  }
+
+ private:
+  T value_{};
+};
+
+template <typename T>
+class SlotCell<T, true> {
+ public:
+  T Load() const {
+    return value_.load(std::memory_order_relaxed);
+  }
+
+  void Store(const T value) {
+    value_.store(value, std::memory_order_relaxed);
+  }
+
+  T Take() {
+    return Load();
+  }
+
+ private:
+  std::atomic<T> value_{T{}};
+};
+
+// Open addressing with one control byte per slot: empty, deleted or
+// 7 bits of the hash of a full slot. Slots are probed a group of 16 at
+// a time (with SSE2 when available), and the element itself is compared
+// only when its control byte matches. T must be default constructible
+//
+// Control bytes are packed eight to a relaxed atomic word, and for
+// trivially copyable T slots are relaxed atomics too, so Contains may run
+// concurrently with writers; StripedHashSet discards its answer with the
+// stripe version if it raced one. The arrays are never replaced: once
+// live elements and tombstones reach 7/8 of the slots the table asks to
+// be migrated, to one twice as large if live elements alone take more
+// than 7/16 of it. Inserts during that migration go to the new table,
+// and the owner finishes migrating long before it fills up
+
+template <typename T, class Hasher>
+class FlatBuckets {
+  using ControlByte = int8_t;
+  using ControlWord = uint64_t;
+
+  static const size_t kGroupSize = 16;
+  static const size_t kBytesPerWord = sizeof(ControlWord);
+  static const ControlByte kEmpty = -128;
+  static const ControlByte kDeleted = -2;
+  static const ControlWord kEmptyWord = 0x8080808080808080ull;
+  static const size_t kNotFound = static_cast<size_t>(-1);
+
+  // bitmask of the slots in a group, bit i is for slot i
+  using GroupMask = uint32_t;
+
+ public:
+  static const bool kOptimisticReads = std::is_trivially_copyable<T>::value;
+
+ private:
+  struct Layout {
+    const size_t capacity_;
+    std::vector<std::atomic<ControlWord>> control_;
+    std::vector<SlotCell<T, kOptimisticReads>> slots_;
+
+    explicit Layout(const size_t capacity)
+        : capacity_(capacity),
+          control_(capacity / kBytesPerWord),
+          slots_(capacity) {
+      for (auto& word_ : control_) {
+        word_.store(kEmptyWord, std::memory_order_relaxed);
+      }
+    }
+  };
+
+  // control bytes of one group, byte i of low_ is for slot i
+  struct Group {
+    ControlWord low_;
+    ControlWord high_;
+  };
+
+ public:
+  FlatBuckets(const size_t bucket_count, Hasher hasher)
+      : hasher_(hasher), layout_(CapacityFor(bucket_count)) {
+  }
+
+  bool Insert(T element, const size_t hash) {
+    const size_t mixed_hash_ = Mix(hash);
+    if (Find(layout_, element, mixed_hash_) != kNotFound) {
+      return false;
+    }
+    assert(size_ + deleted_ < layout_.capacity_);
+    Place(layout_, std::move(element), mixed_hash_);
+    ++size_;
+    return true;
+  }
+
+  bool Remove(const T& element, const size_t hash) {
+    const size_t slot_ = Find(layout_, element, Mix(hash));
+    if (slot_ == kNotFound) {
+      return false;
+    }
+    SetControl(layout_, slot_, kDeleted);
+    layout_.slots_[slot_].Store(T{});
+    --size_;
+    ++deleted_;
+    return true;
+  }
+
+  bool Contains(const T& element, const size_t hash) const {
+    return Find(layout_, element, Mix(hash)) != kNotFound;
+  }
+
+  size_t GetBucketCount() const {
+    return layout_.capacity_;
+  }
+
+  // the next Insert would take the table past 7/8 of its slots
+  bool NeedsRebuild() const {
+    return (size_ + deleted_ + 1) * 8 > layout_.capacity_ * 7;
+  }
+
+  size_t GetRebuildBucketCount() const {
+    size_t capacity_ = layout_.capacity_;
+    while ((size_ + 1) * 16 > capacity_ * 7) {
+      capacity_ <<= 1;
+    }
+    return capacity_;
+  }
+
+  // every slot counts as a bucket
+  bool MigrateTo(FlatBuckets& target, const size_t max_buckets) {
+    for (size_t i = 0; i < max_buckets && migrated_ < layout_.capacity_;
+         ++i, ++migrated_) {
+      if (GetControl(layout_, migrated_) >= 0) {
+        T element_ = layout_.slots_[migrated_].Take();
+        const size_t hash_ = hasher_(element_);
+        target.Insert(std::move(element_), hash_);
+        SetControl(layout_, migrated_, kDeleted);
+        --size_;
+        ++deleted_;
+      }
+    }
+    return migrated_ == layout_.capacity_;
+  }
+
+ private:
+  static size_t CapacityFor(const size_t bucket_count) {
+    size_t capacity_ = kGroupSize;
+    while (capacity_ < bucket_count) {
+      capacity_ <<= 1;
+    }
+    return capacity_;
+  }
+
+  // std::hash of integers is identity, spread it before splitting
+  static size_t Mix(const size_t hash) {
+    uint64_t mixed_ = static_cast<uint64_t>(hash) * 0x9E3779B97F4A7C15ull;
+    return static_cast<size_t>(mixed_ ^ (mixed_ >> 32));
+  }
+
+  static ControlByte GetFingerprint(const size_t mixed_hash) {
+    return static_cast<ControlByte>(mixed_hash & 0x7F);
+  }
+
+  static ControlByte GetControl(const Layout& layout, const size_t slot) {
+    const ControlWord word_ =
+        layout.control_[slot / kBytesPerWord].load(std::memory_order_relaxed);
+    return static_cast<ControlByte>(word_ >> (8 * (slot % kBytesPerWord)));
+  }
+
+  // writers only, under the stripe lock
+  static void SetControl(Layout& layout, const size_t slot,
+                         const ControlByte byte) {
+    std::atomic<ControlWord>& word_ = layout.control_[slot / kBytesPerWord];
+    const size_t shift_ = 8 * (slot % kBytesPerWord);
+    ControlWord value_ = word_.load(std::memory_order_relaxed);
+    value_ &= ~(ControlWord{0xFF} << shift_);
+    value_ |= static_cast<ControlWord>(static_cast<uint8_t>(byte)) << shift_;
+    word_.store(value_, std::memory_order_relaxed);
+  }
+
+  static Group LoadGroup(const Layout& layout, const size_t group) {
+    const size_t first_word_ = group * kGroupSize / kBytesPerWord;
+    return {layout.control_[first_word_].load(std::memory_order_relaxed),
+            layout.control_[first_word_ + 1].load(std::memory_order_relaxed)};
+  }
+
+  static size_t GetFirstGroup(const Layout& layout, const size_t mixed_hash) {
+    return (mixed_hash >> 7) & (layout.capacity_ / kGroupSize - 1);
+  }
+
+  // triangular probing visits every group once
+  static size_t GetNextGroup(const Layout& layout, const size_t group,
+                             const size_t probe) {
+    return (group + probe) & (layout.capacity_ / kGroupSize - 1);
+  }
+
+  static ControlByte GetGroupByte(const Group& group, const size_t index) {
+    const ControlWord word_ = index < kBytesPerWord ? group.low_ : group.high_;
+    return static_cast<ControlByte>(word_ >> (8 * (index % kBytesPerWord)));
+  }
+
+  static GroupMask Match(const Group& group, const ControlByte byte) {
+#ifdef __SSE2__
+    __m128i control_bytes_ =
+        _mm_set_epi64x(static_cast<long long>(group.high_),
+                       static_cast<long long>(group.low_));
+    return static_cast<GroupMask>(_mm_movemask_epi8(
+        _mm_cmpeq_epi8(control_bytes_, _mm_set1_epi8(byte))));
+#else
+    GroupMask mask_ = 0;
+    for (size_t i = 0; i < kGroupSize; ++i) {
+      mask_ |= static_cast<GroupMask>(GetGroupByte(group, i) == byte) << i;
+    }
+    return mask_;
+#endif
+  }
+
+  // empty and deleted are the only negative control bytes
+  static GroupMask MatchEmptyOrDeleted(const Group& group) {
+#ifdef __SSE2__
+    return static_cast<GroupMask>(
+        _mm_movemask_epi8(_mm_set_epi64x(static_cast<long long>(group.high_),
+                                         static_cast<long long>(group.low_))));
+#else
+    GroupMask mask_ = 0;
+    for (size_t i = 0; i < kGroupSize; ++i) {
+      mask_ |= static_cast<GroupMask>(GetGroupByte(group, i) < 0) << i;
+    }
+    return mask_;
+#endif
+  }
+
+  static size_t LowestSlot(const GroupMask mask) {
+    return static_cast<size_t>(__builtin_ctz(mask));
+  }
+
+  // terminates even if layout is being modified concurrently
+  static size_t Find(const Layout& layout, const T& element,
+                     const size_t mixed_hash) {
+    const size_t group_count_ = layout.capacity_ / kGroupSize;
+    size_t group_ = GetFirstGroup(layout, mixed_hash);
+    for (size_t probe_ = 1; probe_ <= group_count_; ++probe_) {
+      const Group control_ = LoadGroup(layout, group_);
+      for (GroupMask mask_ = Match(control_, GetFingerprint(mixed_hash));
+           mask_ != 0; mask_ &= mask_ - 1) {
+        const size_t slot_ = group_ * kGroupSize + LowestSlot(mask_);
+        if (layout.slots_[slot_].Load() == element) {
+          return slot_;
+        }
+      }
+      if (Match(control_, kEmpty) != 0) {
+        return kNotFound;
+      }
+      group_ = GetNextGroup(layout, group_, probe_);
+    }
+    return kNotFound;
+  }
+
+  // there is always a free slot, the owner migrates the table before
+  // it fills up
+  void Place(Layout& layout, T element, const size_t mixed_hash) {
+    size_t group_ = GetFirstGroup(layout, mixed_hash);
+    GroupMask mask_;
+    for (size_t probe_ = 1;
+         (mask_ = MatchEmptyOrDeleted(LoadGroup(layout, group_))) == 0;
+         ++probe_) {
+      group_ = GetNextGroup(layout, group_, probe_);
+    }
+    const size_t slot_ = group_ * kGroupSize + LowestSlot(mask_);
+    if (GetControl(layout, slot_) == kDeleted) {
+      --deleted_;
+    }
+    // the element is in place before its control byte announces it
+    layout.slots_[slot_].Store(std::move(element));
+    SetControl(layout, slot_, GetFingerprint(mixed_hash));
+  }
+
+ private:
+  Hasher hasher_;
+  size_t size_{0};
+  size_t deleted_{0};
+  size_t migrated_{0};
+  Layout layout_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Epochs of optimistic readers, shared by all sets of the process.
+// A reader announces the global epoch in a record of its own, on its own
+// cache line, while it looks at a stripe, so reads never write to a line
+// other threads use. A table retired in epoch e is unreachable once
+// every record is idle or announces a later epoch. Records are never
+// freed; the record of an exited thread is taken over by a new one
+
+class ReaderEpochs {
+  static const size_t kCacheLineSize = 64;
+  static const uint64_t kIdle = ~uint64_t{0};
+
+  struct alignas(kCacheLineSize) Record {
+    tpcc::atomic<uint64_t> epoch_{kIdle};
+    tpcc::atomic<bool> owned_{true};
+    Record* next_{nullptr};
+  };
+
+  // gives the record back when its thread exits
+  struct RecordOwner {
+    Record* record_{AcquireRecord()};
+
+    ~RecordOwner() {
+      record_->owned_.store(false);
+    }
+  };
+
+ public:
+  class Guard {
+   public:
+    Guard() : record_(GetThreadRecord()) {
+      record_.epoch_.store(GetEpoch().load());
+    }
+
+    ~Guard() {
+      record_.epoch_.store(kIdle);
+    }
+
+   private:
+    Record& record_;
+  };
+
+  // after the memory was made unreachable for new readers,
+  // returns the epoch it was retired in
+  static uint64_t Retire() {
+    return GetEpoch().fetch_add(1);
+  }
+
+  // memory retired in an earlier epoch can be freed
+  static uint64_t GetOldestEpoch() {
+    uint64_t oldest_ = kIdle;
+    for (Record* record_ = GetRecords().load(); record_ != nullptr;
+         record_ = record_->next_) {
+      oldest_ = std::min(oldest_, record_->epoch_.load());
+    }
+    return oldest_;
+  }
+
+ private:
+  static tpcc::atomic<uint64_t>& GetEpoch() {
+    static tpcc::atomic<uint64_t> epoch_{0};
+    return epoch_;
+  }
+
+  static tpcc::atomic<Record*>& GetRecords() {
+    static tpcc::atomic<Record*> records_{nullptr};
+    return records_;
+  }
+
+  static Record& GetThreadRecord() {
+    static thread_local RecordOwner owner_;
+    return *owner_.record_;
+  }
+
+  static Record* AcquireRecord() {
+    tpcc::atomic<Record*>& records_ = GetRecords();
+    for (Record* record_ = records_.load(); record_ != nullptr;
+         record_ = record_->next_) {
+      bool owned_ = false;
+      if (!record_->owned_.load() &&
+          record_->owned_.compare_exchange_strong(owned_, true)) {
+        return record_;
+      }
+    }
+    void* memory_ = nullptr;
+    if (posix_memalign(&memory_, kCacheLineSize, sizeof(Record)) != 0) {
+      throw std::bad_alloc();
+    }
+    Record* record_ = new (memory_) Record{};
+    Record* head_ = records_.load();
+    do {
+      record_->next_ = head_;
+    } while (!records_.compare_exchange_weak(head_, record_));
+    return record_;
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Bucket i of the table belongs to stripe i % concurrency_level, so every
+// stripe keeps its buckets in its own Storage and indexes them by
+// hash / concurrency_level
+//
+// Growth is incremental: Insert only raises the target bucket count.
+// The next writer of each stripe moves its table aside and starts a new
+// one, and every writer then migrates a bounded number of buckets from
+// the old table. A table that asks for a rebuild (too many tombstones
+// or slots taken) is migrated the same way. Until migration is over
+// both tables are consulted, and a reader that finds the stripe lock
+// free migrates a share as well, so read-mostly stripes finish too.
+// RWLock needs try_lock for that
+//
+// Writers bump the stripe version before and after their critical section.
+// If Storage allows, Contains reads the stripe without locking it and
+// retries when the version tells it raced a writer (seqlock). Drained
+// tables optimistic readers might still be reading are retired to
+// ReaderEpochs and freed by a later writer of the stripe
+
+template <typename T, class HashFunction = std::hash<T>,
+          template <typename, class> class Storage = ChainedBuckets,
+          class RWLock = ReaderWriterLock>
+class StripedHashSet {
+ private:
   using ReaderLocker = std::shared_lock<RWLock>;
   using WriterLocker = std::unique_lock<RWLock>;
 
-  using Bucket = std::forward_list<T>;
-  using Buckets = std::vector<Bucket>;
+  struct StripeHasher {
+    size_t concurrency_level_;
+
+    size_t operator()(const T& element) const {
+      return HashFunction{}(element) / concurrency_level_;
+    }
+  };
+
+  using Table = Storage<T, StripeHasher>;
+
+  struct RetiredTable {
+    uint64_t epoch_;
+    std::unique_ptr<Table> table_;
+  };
+
+  struct Stripe {
+    // odd while a writer is inside
+    tpcc::atomic<size_t> version_{0};
+    tpcc::atomic<Table*> table_{nullptr};
+    tpcc::atomic<Table*> old_table_{nullptr};
+    std::unique_ptr<Table> table_owner_;
+    std::unique_ptr<Table> old_table_owner_;
+    // drained tables that optimistic readers may still look at
+    std::vector<RetiredTable> retired_tables_;
+    size_t bucket_count_{0};
+  };
+
+  // marks a writer critical section on a stripe for optimistic readers
+  class VersionGuard {
+   public:
+    explicit VersionGuard(Stripe& stripe) : stripe_(stripe) {
+      stripe_.version_.store(stripe_.version_.load() + 1);
+      std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    ~VersionGuard() {
+      stripe_.version_.store(stripe_.version_.load() + 1);
+    }
+
+   private:
+    Stripe& stripe_;
+  };
+
+  // buckets migrated by one writer
+  static const size_t kMigrationBudget = 16;
+  // lock-free attempts of Contains before it takes the reader lock
+  static const size_t kOptimisticAttempts = 64;
 
  public:
   explicit StripedHashSet(const size_t concurrency_level = 4,
                           const size_t growth_factor = 2,
                           const double max_load_factor = 0.8)
-      : concurrency_level_(concurrency_level),
+      : stripes_(concurrency_level),
+        concurrency_level_(concurrency_level),
         growth_factor_(growth_factor),
-        max_load_factor_(max_load_factor),
-        // stripe_locks_(concurrency_level),
-        elements_(concurrency_level) {
+        max_load_factor_(max_load_factor) {
     for (size_t i = 0; i < concurrency_level_; ++i) {
-      stripe_locks_.push_back(new RWLock);
+      stripe_locks_.push_back(NewStripeLock());
+      Stripe& stripe_ = stripes_[i];
+      stripe_.bucket_count_ = buckets_per_stripe_.load();
+      stripe_.table_owner_.reset(
+          new Table(stripe_.bucket_count_, StripeHasher{concurrency_level_}));
+      stripe_.table_.store(stripe_.table_owner_.get());
     }
   }
 
   ~StripedHashSet() {
     for (size_t i = 0; i < concurrency_level_; ++i) {
-      delete stripe_locks_[i];
+      DeleteStripeLock(stripe_locks_[i]);
     }
   }
 
   bool Insert(T element) {
     size_t hash_value_ = HashFunction{}(element);
+    size_t local_hash_ = GetLocalHash(hash_value_);
     auto stripe_lock_ = LockStripe<WriterLocker>(hash_value_);
-    size_t bucket_index_ = GetBucketIndex(hash_value_);
-    Bucket& bucket_ = GetBucket(bucket_index_);
-    if (std::find(bucket_.cbegin(), bucket_.cend(), element) != bucket_.end()) {
+    Stripe& stripe_ = GetStripe(hash_value_);
+    VersionGuard version_guard_{stripe_};
+    MigrateSome(stripe_);
+    ReclaimRetired(stripe_);
+    if (stripe_.old_table_owner_ != nullptr &&
+        stripe_.old_table_owner_->Contains(element, local_hash_)) {
+      return false;
+    }
+    if (!stripe_.table_owner_->Insert(std::move(element), local_hash_)) {
       return false;
     } else {
-      bucket_.push_front(element);
       ++elements_in_set_;
       if (MaxLoadFactorExceeded()) {
-        size_t arr_size = elements_.size();
-        stripe_lock_.unlock();
-        TryExpandTable(arr_size);
+        size_t buckets_per_stripe = buckets_per_stripe_.load();
+        buckets_per_stripe_.compare_exchange_strong(
+            buckets_per_stripe, buckets_per_stripe * growth_factor_);
       }
       return true;
     }
@@ -110,15 +786,17 @@ class StripedHashSet {
 
   bool Remove(const T& element) {
     size_t hash_value_ = HashFunction{}(element);
+    size_t local_hash_ = GetLocalHash(hash_value_);
     auto stripe_lock_ = LockStripe<WriterLocker>(hash_value_);
-    size_t bucket_index_ = GetBucketIndex(hash_value_);
-    Bucket& bucket_ = GetBucket(bucket_index_);
-    auto remove_candidate_ =
-        std::find(bucket_.cbegin(), bucket_.cend(), element);
-    if (remove_candidate_ == bucket_.end()) {
+    Stripe& stripe_ = GetStripe(hash_value_);
+    VersionGuard version_guard_{stripe_};
+    MigrateSome(stripe_);
+    ReclaimRetired(stripe_);
+    if (!stripe_.table_owner_->Remove(element, local_hash_) &&
+        (stripe_.old_table_owner_ == nullptr ||
+         !stripe_.old_table_owner_->Remove(element, local_hash_))) {
       return false;
     } else {
-      bucket_.remove(element);
       --elements_in_set_;
       return true;
     }
@@ -126,11 +804,29 @@ class StripedHashSet {
 
   bool Contains(const T& element) const {
     size_t hash_value_ = HashFunction{}(element);
+    size_t local_hash_ = GetLocalHash(hash_value_);
+    const Stripe& stripe_ = GetStripe(hash_value_);
+    if (stripe_.old_table_.load() != nullptr) {
+      HelpMigrate(hash_value_);
+    }
+    if (Table::kOptimisticReads) {
+      ReaderEpochs::Guard epoch_guard_;
+      for (size_t i = 0; i < kOptimisticAttempts; ++i) {
+        size_t version_ = stripe_.version_.load();
+        if (version_ % 2 == 1) {
+          contention::Count(contention::kValidationRetries);
+          continue;
+        }
+        bool found_ = LookUp(stripe_, element, local_hash_);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (stripe_.version_.load() == version_) {
+          return found_;
+        }
+        contention::Count(contention::kValidationRetries);
+      }
+    }
     auto stripe_lock_ = LockStripe<ReaderLocker>(hash_value_);
-    size_t bucket_index_ = GetBucketIndex(hash_value_);
-    const Bucket& bucket_ = GetBucket(bucket_index_);
-    return std::find(bucket_.cbegin(), bucket_.cend(), element) !=
-           bucket_.cend();
+    return LookUp(stripe_, element, local_hash_);
   }
 
   size_t GetSize() const {
@@ -138,8 +834,7 @@ class StripedHashSet {
   }
 
   size_t GetBucketCount() const {
-    auto stripe_lock_ = LockStripe<ReaderLocker>(0);
-    return elements_.size();
+    return buckets_per_stripe_.load() * concurrency_level_;
   }
 
  private:
@@ -147,6 +842,22 @@ class StripedHashSet {
     return hash_value % concurrency_level_;
   }
 
+  // RWLock may be over-aligned, as DistributedReaderWriterLock is, and
+  // plain new ignores that before C++17
+  static RWLock* NewStripeLock() {
+    const size_t alignment_ = std::max(alignof(RWLock), sizeof(void*));
+    void* memory_ = nullptr;
+    if (posix_memalign(&memory_, alignment_, sizeof(RWLock)) != 0) {
+      throw std::bad_alloc();
+    }
+    return new (memory_) RWLock;
+  }
+
+  static void DeleteStripeLock(RWLock* lock) {
+    lock->~RWLock();
+    free(lock);
+  }
+
   template <class Locker>
   Locker LockStripe(const size_t hash_value) const {
     size_t lock_index_ = GetStripeIndex(hash_value);
@@ -155,48 +866,96 @@ class StripedHashSet {
     return std::move(lock_);
   }
 
-  size_t GetBucketIndex(const size_t hash_value) const {
-    return hash_value % elements_.size();
+  size_t GetLocalHash(const size_t hash_value) const {
+    return hash_value / concurrency_level_;
+  }
+
+  Stripe& GetStripe(const size_t hash_value) {
+    return stripes_[GetStripeIndex(hash_value)];
   }
 
-  Bucket& GetBucket(const size_t hash_value) {
-    return elements_[GetBucketIndex(hash_value)];
+  const Stripe& GetStripe(const size_t hash_value) const {
+    return stripes_[GetStripeIndex(hash_value)];
   }
 
-  const Bucket& GetBucket(const size_t hash_value) const {
-    return elements_[GetBucketIndex(hash_value)];
+  static bool LookUp(const Stripe& stripe, const T& element,
+                     const size_t local_hash) {
+    const Table* old_table_ = stripe.old_table_.load();
+    return stripe.table_.load()->Contains(element, local_hash) ||
+           (old_table_ != nullptr && old_table_->Contains(element, local_hash));
   }
 
   bool MaxLoadFactorExceeded() const {
-    return elements_in_set_.load() > max_load_factor_ * elements_.size();
+    return elements_in_set_.load() >
+           max_load_factor_ * buckets_per_stripe_.load() * concurrency_level_;
   }
 
-  void TryExpandTable(const size_t expected_bucket_count) {
-    std::vector<WriterLocker> locks_{concurrency_level_};
-    locks_[0] = LockStripe<WriterLocker>(0);
-    if (elements_.size() != expected_bucket_count) {
-      return void();
-    }
-    for (size_t i = 1; i < concurrency_level_; ++i) {
-      locks_[i] = LockStripe<WriterLocker>(i);
+  // requires writer lock of the stripe;
+  // next migration of a stripe starts only after the previous one is over
+  void MigrateSome(Stripe& stripe) const {
+    if (stripe.old_table_owner_ == nullptr) {
+      size_t buckets_per_stripe = buckets_per_stripe_.load();
+      if (stripe.bucket_count_ == buckets_per_stripe &&
+          !stripe.table_owner_->NeedsRebuild()) {
+        return void();
+      }
+      const size_t bucket_count_ = std::max(
+          buckets_per_stripe, stripe.table_owner_->GetRebuildBucketCount());
+      stripe.old_table_owner_ = std::move(stripe.table_owner_);
+      stripe.old_table_.store(stripe.old_table_owner_.get());
+      stripe.table_owner_.reset(
+          new Table(bucket_count_, StripeHasher{concurrency_level_}));
+      stripe.table_.store(stripe.table_owner_.get());
+      stripe.bucket_count_ = buckets_per_stripe;
     }
-    size_t new_size_ = expected_bucket_count * growth_factor_;
-    std::vector<std::forward_list<T>> new_elements_{new_size_};
-    for (auto& i : elements_) {
-      for (auto& j : i) {
-        size_t hash_value_ = HashFunction{}(j);
-        new_elements_[hash_value_ % new_size_].push_front(j);
+    if (stripe.old_table_owner_->MigrateTo(*stripe.table_owner_,
+                                           kMigrationBudget)) {
+      stripe.old_table_.store(nullptr);
+      if (Table::kOptimisticReads) {
+        stripe.retired_tables_.push_back(RetiredTable{
+            ReaderEpochs::Retire(), std::move(stripe.old_table_owner_)});
       }
+      stripe.old_table_owner_.reset();
+    }
+  }
+
+  // gives up at once if a writer holds the stripe
+  void HelpMigrate(const size_t hash_value) const {
+    WriterLocker stripe_lock_(*stripe_locks_[GetStripeIndex(hash_value)],
+                              std::try_to_lock);
+    if (!stripe_lock_.owns_lock()) {
+      return void();
+    }
+    Stripe& stripe_ = stripes_[GetStripeIndex(hash_value)];
+    if (stripe_.old_table_owner_ == nullptr) {
+      return void();
     }
+    VersionGuard version_guard_{stripe_};
+    MigrateSome(stripe_);
+  }
 
-    elements_ = std::move(new_elements_);
+  // requires writer lock of the stripe
+  static void ReclaimRetired(Stripe& stripe) {
+    auto& retired_ = stripe.retired_tables_;
+    if (retired_.empty()) {
+      return void();
+    }
+    const uint64_t oldest_epoch_ = ReaderEpochs::GetOldestEpoch();
+    retired_.erase(std::remove_if(retired_.begin(), retired_.end(),
+                                  [oldest_epoch_](const RetiredTable& table) {
+                                    return table.epoch_ < oldest_epoch_;
+                                  }),
+                   retired_.end());
   }
 
  private:
-  std::vector<std::forward_list<T>> elements_;
+  // readers migrate too, under the writer lock
+  mutable std::vector<Stripe> stripes_;
   std::vector<RWLock*> stripe_locks_;
   size_t concurrency_level_;
   size_t growth_factor_;
+  // target size of every stripe
+  std::atomic<size_t> buckets_per_stripe_{1};
   std::atomic<size_t> elements_in_set_{0};
   double max_load_factor_;
 };
@@ -1,14 +1,22 @@
 #pragma once
 
+#include "contention.hpp"
+
 #include <tpcc/concurrency/backoff.hpp>
 #include <tpcc/memory/bump_pointer_allocator.hpp>
 #include <tpcc/stdlike/atomic.hpp>
 #include <tpcc/support/compiler.hpp>
 
+#include <array>
+#include <cstdint>
 #include <limits>
+#include <memory>
 #include <mutex>
+#include <new>
 #include <thread>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
 namespace tpcc {
 namespace solutions {
@@ -19,8 +27,9 @@ class SpinLock {
  public:
   void Lock() {
     while (locked_.exchange(true)) {
-      while (locked_.load() == true)
-        ;
+      while (locked_.load() == true) {
+        contention::Count(contention::kSpinIterations);
+      }
     }
   }
 
@@ -42,6 +51,100 @@ class SpinLock {
   tpcc::atomic<bool> locked_{false};
 };
 
+// Test-and-test-and-set lock that backs off while the lock is taken
+
+class BackoffSpinLock {
+ public:
+  void Lock() {
+    Backoff backoff{};
+    while (locked_.exchange(true)) {
+      while (locked_.load()) {
+        contention::Count(contention::kSpinIterations);
+        backoff();
+      }
+    }
+  }
+
+  void Unlock() {
+    locked_.store(false);
+  }
+
+  // adapters for BasicLockable concept
+
+  void lock() {
+    Lock();
+  }
+
+  void unlock() {
+    Unlock();
+  }
+
+ private:
+  tpcc::atomic<bool> locked_{false};
+};
+
+// Node lock policies of the sets below must be BasicLockable.
+// These adapters plug in locks with Lock/Unlock (TicketLock, AdaptiveLock)
+// and guard-based locks (QueueSpinLock). A guard holds the queue node of
+// a waiter, so it can't share storage with the owner's guard; instead
+// every thread keeps the storage of its released guards and reuses it,
+// and the heap is touched only when a thread holds more guards at once
+// than ever before
+
+template <class Lock>
+class LockableAdapter {
+ public:
+  void lock() {
+    lock_.Lock();
+  }
+
+  void unlock() {
+    lock_.Unlock();
+  }
+
+ private:
+  Lock lock_;
+};
+
+template <class Lock>
+class GuardLockableAdapter {
+  using Guard = typename Lock::LockGuard;
+  using GuardStorage =
+      typename std::aligned_storage<sizeof(Guard), alignof(Guard)>::type;
+  using SpareStorage = std::vector<std::unique_ptr<GuardStorage>>;
+
+ public:
+  void lock() {
+    SpareStorage& spares_ = GetSpareStorage();
+    std::unique_ptr<GuardStorage> storage_;
+    if (spares_.empty()) {
+      storage_.reset(new GuardStorage);
+    } else {
+      storage_ = std::move(spares_.back());
+      spares_.pop_back();
+    }
+    owner_guard_ = new (storage_.release()) Guard(lock_);
+  }
+
+  // only the owner gets here
+  void unlock() {
+    Guard* guard_ = owner_guard_;
+    owner_guard_ = nullptr;
+    guard_->~Guard();
+    GetSpareStorage().emplace_back(reinterpret_cast<GuardStorage*>(guard_));
+  }
+
+ private:
+  static SpareStorage& GetSpareStorage() {
+    static thread_local SpareStorage spares_;
+    return spares_;
+  }
+
+ private:
+  Lock lock_;
+  Guard* owner_guard_{nullptr};
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 
 // don't touch this
@@ -58,21 +161,22 @@ struct KeyTraits {
 
 ////////////////////////////////////////////////////////////////////////////////
 
-template <typename T, class TTraits = KeyTraits<T>>
+template <typename T, class TTraits = KeyTraits<T>,
+          class NodeLock = SpinLock>
 class OptimisticLinkedSet {
  private:
   struct Node {
     T key_;
     tpcc::atomic<Node*> next_;
-    SpinLock spinlock_;
+    NodeLock lock_;
     tpcc::atomic<bool> marked_{false};
 
     Node(const T& key, Node* next = nullptr) : key_(key), next_(next) {
     }
 
     // use: auto node_lock = node->Lock();
-    std::unique_lock<SpinLock> Lock() {
-      return std::unique_lock<SpinLock>{spinlock_};
+    std::unique_lock<NodeLock> Lock() {
+      return std::unique_lock<NodeLock>{lock_};
     }
   };
 
@@ -96,6 +200,7 @@ class OptimisticLinkedSet {
       auto pred_lock_ = edge_.pred_->Lock();
       auto curr_lock_ = edge_.curr_->Lock();
       if (!Validate(edge_)) {
+        contention::Count(contention::kValidationRetries);
         continue;
       }
       if (edge_.curr_->key_ == key) {
@@ -115,6 +220,7 @@ class OptimisticLinkedSet {
       auto pred_lock_ = edge_.pred_->Lock();
       auto curr_lock_ = edge_.curr_->Lock();
       if (!Validate(edge_)) {
+        contention::Count(contention::kValidationRetries);
         continue;
       }
       if (edge_.curr_->key_ != key) {
@@ -165,5 +271,397 @@ class OptimisticLinkedSet {
   tpcc::atomic<size_t> size_{0};
 };
 
+////////////////////////////////////////////////////////////////////////////////
+
+// Lazy skip list: the same optimistic protocol (and the same node lock
+// policy) as OptimisticLinkedSet applied to every level. Nodes are
+// located without locks, then the predecessors are locked bottom-up (in
+// descending key order, so there are no deadlocks) and validated. A node
+// is in the set iff it is fully linked and not marked
+
+template <typename T, class TTraits = KeyTraits<T>,
+          class NodeLock = SpinLock>
+class OptimisticSkipListSet {
+ private:
+  // with promotion probability 1/4 enough for ~16M keys
+  static const size_t kMaxHeight = 12;
+
+  // next_ points to the tower of a Tower<height_>, so a node takes only
+  // as many links as it has levels
+  struct Node {
+    T key_;
+    size_t height_;
+    tpcc::atomic<Node*>* next_{nullptr};
+    NodeLock lock_;
+    tpcc::atomic<bool> marked_{false};
+    tpcc::atomic<bool> fully_linked_{false};
+
+    Node(const T& key, const size_t height) : key_(key), height_(height) {
+    }
+
+    // use: auto node_lock = node->Lock();
+    std::unique_lock<NodeLock> Lock() {
+      return std::unique_lock<NodeLock>{lock_};
+    }
+  };
+
+  template <size_t kHeight>
+  struct Tower : Node {
+    std::array<tpcc::atomic<Node*>, kHeight> levels_;
+
+    explicit Tower(const T& key) : Node(key, kHeight) {
+      for (auto& next : levels_) {
+        next.store(nullptr);
+      }
+      this->next_ = levels_.data();
+    }
+  };
+
+  using Level = std::array<Node*, kMaxHeight>;
+  using LevelLocks = std::array<std::unique_lock<NodeLock>, kMaxHeight>;
+
+  static const size_t kNotFound = kMaxHeight;
+
+ public:
+  explicit OptimisticSkipListSet(BumpPointerAllocator& allocator)
+      : allocator_(allocator) {
+    CreateEmptyList();
+  }
+
+  bool Insert(T key) {
+    const size_t height_ = GetRandomHeight();
+    Level preds_;
+    Level succs_;
+    while (true) {
+      size_t found_level_ = Locate(key, preds_, succs_);
+      if (found_level_ != kNotFound) {
+        Node* found_ = succs_[found_level_];
+        if (!found_->marked_) {
+          while (!found_->fully_linked_) {
+            contention::Count(contention::kSpinIterations);
+          }
+          return false;
+        }
+        // being removed, wait until it is unlinked
+        contention::Count(contention::kValidationRetries);
+        continue;
+      }
+      LevelLocks pred_locks_;
+      if (!LockAndValidate(preds_, succs_, height_, pred_locks_)) {
+        contention::Count(contention::kValidationRetries);
+        continue;
+      }
+      Node* to_be_inserted_ = NewNode(key, height_);
+      for (size_t level = 0; level < height_; ++level) {
+        to_be_inserted_->next_[level].store(succs_[level]);
+      }
+      for (size_t level = 0; level < height_; ++level) {
+        preds_[level]->next_[level].store(to_be_inserted_);
+      }
+      to_be_inserted_->fully_linked_ = true;
+      ++size_;
+      return true;
+    }
+  }
+
+  bool Remove(const T& key) {
+    Node* victim_ = nullptr;
+    std::unique_lock<NodeLock> victim_lock_;
+    Level preds_;
+    Level succs_;
+    while (true) {
+      size_t found_level_ = Locate(key, preds_, succs_);
+      if (victim_ == nullptr) {
+        if (found_level_ == kNotFound ||
+            !CanBeRemoved(succs_[found_level_], found_level_)) {
+          return false;
+        }
+        victim_ = succs_[found_level_];
+        victim_lock_ = victim_->Lock();
+        if (victim_->marked_) {
+          return false;
+        }
+        victim_->marked_ = true;
+      }
+      LevelLocks pred_locks_;
+      if (!LockAndValidate(preds_, succs_, victim_->height_, pred_locks_,
+                           victim_)) {
+        contention::Count(contention::kValidationRetries);
+        continue;
+      }
+      for (size_t level = victim_->height_; level-- > 0;) {
+        preds_[level]->next_[level].store(victim_->next_[level]);
+      }
+      --size_;
+      return true;
+    }
+  }
+
+  bool Contains(const T& key) const {
+    Level preds_;
+    Level succs_;
+    size_t found_level_ = Locate(key, preds_, succs_);
+    return found_level_ != kNotFound &&
+           succs_[found_level_]->fully_linked_ &&
+           !succs_[found_level_]->marked_;
+  }
+
+  size_t GetSize() const {
+    return size_.load();
+  }
+
+ private:
+  void CreateEmptyList() {
+    // create sentinel nodes
+    const size_t height_ = kMaxHeight;
+    head_ = NewNode(TTraits::LowerBound(), height_);
+    Node* tail_ = NewNode(TTraits::UpperBound(), height_);
+    for (size_t level = 0; level < kMaxHeight; ++level) {
+      head_->next_[level].store(tail_);
+    }
+    head_->fully_linked_ = true;
+    tail_->fully_linked_ = true;
+  }
+
+  Node* NewNode(const T& key, const size_t height) {
+    return NewNode(key, height, std::make_index_sequence<kMaxHeight>{});
+  }
+
+  // picks the Tower type for a height known only at run time
+  template <size_t... kHeights>
+  Node* NewNode(const T& key, const size_t height,
+                std::index_sequence<kHeights...>) {
+    using Factory = Node* (*)(BumpPointerAllocator&, const T&);
+    static const Factory kFactories[] = {&NewTower<kHeights + 1>...};
+    return kFactories[height - 1](allocator_, key);
+  }
+
+  template <size_t kHeight>
+  static Node* NewTower(BumpPointerAllocator& allocator, const T& key) {
+    return allocator.New<Tower<kHeight>>(key);
+  }
+
+  // returns the highest level where key was found or kNotFound
+  size_t Locate(const T& key, Level& preds, Level& succs) const {
+    size_t found_level_ = kNotFound;
+    Node* less_ = head_;
+    for (size_t level = kMaxHeight; level-- > 0;) {
+      Node* more_ = less_->next_[level];
+      while (more_->key_ < key) {
+        less_ = more_;
+        more_ = more_->next_[level];
+      }
+      if (found_level_ == kNotFound && more_->key_ == key) {
+        found_level_ = level;
+      }
+      preds[level] = less_;
+      succs[level] = more_;
+    }
+    return found_level_;
+  }
+
+  // the same predecessor is locked once for consecutive levels;
+  // victim is the node being removed, it is marked by the remover
+  bool LockAndValidate(const Level& preds, const Level& succs,
+                       const size_t height, LevelLocks& locks,
+                       const Node* victim = nullptr) const {
+    Node* prev_pred_ = nullptr;
+    for (size_t level = 0; level < height; ++level) {
+      Node* pred_ = preds[level];
+      Node* succ_ = succs[level];
+      if (pred_ != prev_pred_) {
+        locks[level] = pred_->Lock();
+        prev_pred_ = pred_;
+      }
+      if (pred_->marked_ || (succ_ != victim && succ_->marked_) ||
+          pred_->next_[level] != succ_) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static bool CanBeRemoved(const Node* node, const size_t found_level) {
+    return node->fully_linked_ && node->height_ - 1 == found_level &&
+           !node->marked_;
+  }
+
+  static size_t GetRandomHeight() {
+    static thread_local uint32_t state_ = 0x9E3779B9u;
+    size_t height_ = 1;
+    while (height_ < kMaxHeight) {
+      state_ ^= state_ << 13;
+      state_ ^= state_ >> 17;
+      state_ ^= state_ << 5;
+      if ((state_ & 3) != 0) {
+        break;
+      }
+      ++height_;
+    }
+    return height_;
+  }
+
+ private:
+  BumpPointerAllocator& allocator_;
+  Node* head_{nullptr};
+  tpcc::atomic<size_t> size_{0};
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Harris-Michael lock-free list with the interface of OptimisticLinkedSet.
+// A node is logically removed by marking its next pointer, and marked
+// nodes are unlinked by whoever traverses them. Nodes come from the bump
+// pointer allocator and are never freed, so there is no ABA
+
+template <typename T, class TTraits = KeyTraits<T>>
+class LockFreeLinkedSet {
+ private:
+  struct Node;
+
+  // next pointer with the removal mark of its owner in the lowest bit
+  class MarkedPointer {
+   public:
+    MarkedPointer() = default;
+
+    MarkedPointer(Node* ptr, const bool marked)
+        : word_(reinterpret_cast<uintptr_t>(ptr) |
+                static_cast<uintptr_t>(marked)) {
+    }
+
+    Node* Get() const {
+      return reinterpret_cast<Node*>(word_ & ~uintptr_t{1});
+    }
+
+    bool IsMarked() const {
+      return (word_ & 1) != 0;
+    }
+
+   private:
+    uintptr_t word_{0};
+  };
+
+  struct Node {
+    T key_;
+    tpcc::atomic<MarkedPointer> next_;
+
+    Node(const T& key, Node* next = nullptr)
+        : key_(key), next_(MarkedPointer{next, false}) {
+    }
+  };
+
+  struct EdgeCandidate {
+    Node* pred_;
+    Node* curr_;
+
+    EdgeCandidate(Node* pred, Node* curr) : pred_(pred), curr_(curr) {
+    }
+  };
+
+ public:
+  explicit LockFreeLinkedSet(BumpPointerAllocator& allocator)
+      : allocator_(allocator) {
+    CreateEmptyList();
+  }
+
+  bool Insert(T key) {
+    Node* to_be_inserted_ = nullptr;
+    while (true) {
+      auto edge_ = Locate(key);
+      if (edge_.curr_->key_ == key) {
+        return false;
+      }
+      if (to_be_inserted_ == nullptr) {
+        to_be_inserted_ = allocator_.New<Node>(key, edge_.curr_);
+      } else {
+        to_be_inserted_->next_.store({edge_.curr_, false});
+      }
+      MarkedPointer expected_{edge_.curr_, false};
+      if (edge_.pred_->next_.compare_exchange_strong(
+              expected_, {to_be_inserted_, false})) {
+        ++size_;
+        return true;
+      }
+      contention::Count(contention::kCasRetries);
+    }
+  }
+
+  bool Remove(const T& key) {
+    while (true) {
+      auto edge_ = Locate(key);
+      if (edge_.curr_->key_ != key) {
+        return false;
+      }
+      MarkedPointer succ_ = edge_.curr_->next_.load();
+      if (succ_.IsMarked()) {
+        continue;
+      }
+      if (!edge_.curr_->next_.compare_exchange_strong(
+              succ_, {succ_.Get(), true})) {
+        contention::Count(contention::kCasRetries);
+        continue;
+      }
+      // physical removal is optional, Locate will help otherwise
+      MarkedPointer expected_{edge_.curr_, false};
+      edge_.pred_->next_.compare_exchange_strong(expected_,
+                                                 {succ_.Get(), false});
+      --size_;
+      return true;
+    }
+  }
+
+  // wait-free
+  bool Contains(const T& key) const {
+    Node* curr_ = head_;
+    while (curr_->key_ < key) {
+      curr_ = curr_->next_.load().Get();
+    }
+    return curr_->key_ == key && !curr_->next_.load().IsMarked();
+  }
+
+  size_t GetSize() const {
+    return size_.load();
+  }
+
+ private:
+  void CreateEmptyList() {
+    // create sentinel nodes
+    head_ = allocator_.New<Node>(TTraits::LowerBound());
+    head_->next_.store({allocator_.New<Node>(TTraits::UpperBound()), false});
+  }
+
+  // unlinks marked nodes on the way
+  EdgeCandidate Locate(const T& key) const {
+    while (true) {
+      Node* less_ = head_;
+      Node* more_ = less_->next_.load().Get();
+      bool restart_ = false;
+      while (!restart_) {
+        MarkedPointer succ_ = more_->next_.load();
+        if (succ_.IsMarked()) {
+          MarkedPointer expected_{more_, false};
+          if (less_->next_.compare_exchange_strong(expected_,
+                                                   {succ_.Get(), false})) {
+            more_ = succ_.Get();
+          } else {
+            contention::Count(contention::kCasRetries);
+            restart_ = true;
+          }
+        } else if (more_->key_ < key) {
+          less_ = more_;
+          more_ = succ_.Get();
+        } else {
+          return {less_, more_};
+        }
+      }
+    }
+  }
+
+ private:
+  BumpPointerAllocator& allocator_;
+  Node* head_{nullptr};
+  tpcc::atomic<size_t> size_{0};
+};
+
 }  // namespace solutions
 }  // namespace tpcc
@@ -1,12 +1,39 @@
 #pragma once
 
+#include "contention.hpp"
+
 #include <tpcc/stdlike/atomic.hpp>
 #include <tpcc/concurrency/backoff.hpp>
 
+#include <sched.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
 namespace tpcc {
 namespace solutions {
 
+// MCS lock. Besides scoped LockGuards it supports TryLock/TryLockFor/
+// TryLockUntil: a timed waiter that gives up marks its queue node as
+// abandoned and leaves at once, and the releaser skips (and frees)
+// abandoned nodes when passing ownership (MCS-try)
+
 class QueueSpinLock {
+  enum class WaitState { Waiting, Owner, Abandoned };
+
+  struct QueueNode {
+    tpcc::atomic<WaitState> state_{WaitState::Waiting};
+    tpcc::atomic<QueueNode*> next_{nullptr};
+  };
+
  public:
   class LockGuard {
    public:
@@ -18,44 +45,304 @@ class QueueSpinLock {
       ReleaseLock();
     }
 
+    // some other guard waits for ownership after this one
+    bool HasSuccessor() const {
+      return node_.next_.load() != nullptr ||
+             spinlock_.wait_queue_tail_.load() != &node_;
+    }
+
    private:
     void AcquireLock() {
       // add self to spinlock queue and wait for ownership
-      LockGuard* prev_tail = spinlock_.wait_queue_tail_.exchange(this);
+      QueueNode* prev_tail = spinlock_.wait_queue_tail_.exchange(&node_);
       if (prev_tail != nullptr) {
-        prev_tail->next_ = this;
+        prev_tail->next_ = &node_;
         Backoff backoff{};
-        while (!is_owner_) {
+        while (node_.state_.load() != WaitState::Owner) {
+          contention::Count(contention::kSpinIterations);
           backoff();
         }
       }
     }
 
     void ReleaseLock() {
-      /* transfer ownership to the next guard node in spinlock wait queue
-       * or reset tail pointer if there are no other contenders
-       */
-      LockGuard* this_ptr_ = this;
-      if (!spinlock_.wait_queue_tail_.compare_exchange_strong(this_ptr_,
-                                                              nullptr)) {
-        Backoff backoff{};
-        while (next_.load() == nullptr) {
-          backoff();
-        }
-        next_.load()->is_owner_.store(true);
-      }
+      spinlock_.PassOwnership(&node_);
     }
 
    private:
     QueueSpinLock& spinlock_;
+    QueueNode node_;
+  };
 
-    tpcc::atomic<bool> is_owner_{false};
-    tpcc::atomic<LockGuard*> next_{nullptr};
+  QueueSpinLock() = default;
+
+  // returns false iff the lock is taken
+  bool TryLock() {
+    if (wait_queue_tail_.load() != nullptr) {
+      return false;
+    }
+    QueueNode* node_ = new QueueNode{};
+    QueueNode* empty_ = nullptr;
+    if (!wait_queue_tail_.compare_exchange_strong(empty_, node_)) {
+      delete node_;
+      return false;
+    }
+    owner_node_ = node_;
+    return true;
+  }
+
+  template <class Rep, class Period>
+  bool TryLockFor(const std::chrono::duration<Rep, Period>& timeout) {
+    return TryLockUntil(std::chrono::steady_clock::now() + timeout);
+  }
+
+  // returns false iff the lock was not acquired before deadline
+  template <class Clock, class Duration>
+  bool TryLockUntil(const std::chrono::time_point<Clock, Duration>& deadline) {
+    // freed by the releaser if abandoned
+    QueueNode* node_ = new QueueNode{};
+    QueueNode* prev_tail = wait_queue_tail_.exchange(node_);
+    if (prev_tail != nullptr) {
+      prev_tail->next_ = node_;
+      Backoff backoff{};
+      while (node_->state_.load() != WaitState::Owner) {
+        if (Clock::now() >= deadline) {
+          WaitState waiting_ = WaitState::Waiting;
+          if (node_->state_.compare_exchange_strong(waiting_,
+                                                    WaitState::Abandoned)) {
+            return false;
+          }
+          // ownership came just in time
+          break;
+        }
+        contention::Count(contention::kSpinIterations);
+        backoff();
+      }
+    }
+    owner_node_ = node_;
+    return true;
+  }
+
+  // for locks taken with TryLock*
+  void Unlock() {
+    QueueNode* node_ = owner_node_;
+    owner_node_ = nullptr;
+    PassOwnership(node_);
+    delete node_;
+  }
+
+ private:
+  /* transfer ownership to the next waiting node in the queue,
+   * skipping abandoned ones, or reset tail pointer if there are
+   * no other contenders
+   */
+  void PassOwnership(QueueNode* owner) {
+    QueueNode* current_ = owner;
+    while (true) {
+      QueueNode* this_ptr_ = current_;
+      if (wait_queue_tail_.compare_exchange_strong(this_ptr_, nullptr)) {
+        break;
+      }
+      Backoff backoff{};
+      while (current_->next_.load() == nullptr) {
+        contention::Count(contention::kSpinIterations);
+        backoff();
+      }
+      QueueNode* next_ = current_->next_.load();
+      if (current_ != owner) {
+        // abandoned, nobody else will touch it
+        delete current_;
+      }
+      WaitState waiting_ = WaitState::Waiting;
+      if (next_->state_.compare_exchange_strong(waiting_, WaitState::Owner)) {
+        return void();
+      }
+      current_ = next_;
+    }
+    if (current_ != owner) {
+      delete current_;
+    }
+  }
+
+ private:
+  // tail of intrusive list of queue nodes
+  tpcc::atomic<QueueNode*> wait_queue_tail_{nullptr};
+  // node of the TryLock* owner, accessed only by the owner
+  QueueNode* owner_node_{nullptr};
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Mapping of cpus to NUMA nodes, read from /sys or given explicitly
+// (e.g. to simulate several nodes on a single-socket machine)
+
+class NumaTopology {
+ public:
+  explicit NumaTopology(std::vector<size_t> cpu_to_node)
+      : cpu_to_node_(std::move(cpu_to_node)) {
+    for (size_t node_ : cpu_to_node_) {
+      if (node_ + 1 > node_count_) {
+        node_count_ = node_ + 1;
+      }
+    }
+  }
+
+  // single node if topology is not available
+  static NumaTopology FromSystem() {
+    std::vector<size_t> cpu_to_node_;
+    for (size_t node_ = 0;; ++node_) {
+      std::ifstream cpu_list_("/sys/devices/system/node/node" +
+                              std::to_string(node_) + "/cpulist");
+      if (!cpu_list_) {
+        break;
+      }
+      std::string ranges_;
+      std::getline(cpu_list_, ranges_);
+      ParseCpuList(ranges_, node_, cpu_to_node_);
+    }
+    return NumaTopology{std::move(cpu_to_node_)};
+  }
+
+  size_t GetNodeCount() const {
+    return node_count_;
+  }
+
+  size_t GetCurrentNode() const {
+    int cpu_ = sched_getcpu();
+    if (cpu_ < 0 || static_cast<size_t>(cpu_) >= cpu_to_node_.size()) {
+      return 0;
+    }
+    return cpu_to_node_[cpu_];
+  }
+
+ private:
+  // cpulist format: "0-3,8-11"
+  static void ParseCpuList(const std::string& ranges, const size_t node,
+                           std::vector<size_t>& cpu_to_node) {
+    std::istringstream ranges_stream_(ranges);
+    std::string range_;
+    while (std::getline(ranges_stream_, range_, ',')) {
+      if (range_.empty()) {
+        continue;
+      }
+      size_t dash_ = range_.find('-');
+      size_t first_ = std::stoul(range_.substr(0, dash_));
+      size_t last_ = dash_ == std::string::npos
+                         ? first_
+                         : std::stoul(range_.substr(dash_ + 1));
+      if (cpu_to_node.size() <= last_) {
+        cpu_to_node.resize(last_ + 1, 0);
+      }
+      for (size_t cpu_ = first_; cpu_ <= last_; ++cpu_) {
+        cpu_to_node[cpu_] = node;
+      }
+    }
+  }
+
+ private:
+  std::vector<size_t> cpu_to_node_;
+  size_t node_count_{1};
+};
+
+// Cohort lock: a QueueSpinLock per NUMA node plus a global ticket lock.
+// The global lock is taken on behalf of the whole node and is passed
+// along the local queue up to max_local_handoffs times in a row,
+// so the protected data stays on one socket for a while
+
+class CohortLock {
+  static const size_t kCacheLineSize = 64;
+
+  struct alignas(kCacheLineSize) NodeState {
+    QueueSpinLock local_lock_;
+    // guarded by local_lock_
+    bool owns_global_{false};
+    size_t local_handoffs_{0};
+  };
+
+  // plain new doesn't honour extended alignment before C++17
+  struct NodeStateDeleter {
+    void operator()(NodeState* state) const {
+      state->~NodeState();
+      std::free(state);
+    }
+  };
+
+  using NodeStatePtr = std::unique_ptr<NodeState, NodeStateDeleter>;
+
+ public:
+  class LockGuard {
+   public:
+    explicit LockGuard(CohortLock& lock)
+        : lock_(lock),
+          node_(lock.GetCurrentNodeState()),
+          local_guard_(node_.local_lock_) {
+      if (!node_.owns_global_) {
+        lock_.AcquireGlobal();
+        node_.owns_global_ = true;
+        node_.local_handoffs_ = 0;
+      }
+    }
+
+    // the local lock is released after the body
+    ~LockGuard() {
+      if (node_.local_handoffs_ < lock_.max_local_handoffs_ &&
+          local_guard_.HasSuccessor()) {
+        ++node_.local_handoffs_;
+      } else {
+        node_.owns_global_ = false;
+        lock_.ReleaseGlobal();
+      }
+    }
+
+   private:
+    CohortLock& lock_;
+    NodeState& node_;
+    QueueSpinLock::LockGuard local_guard_;
   };
 
+  explicit CohortLock(NumaTopology topology = NumaTopology::FromSystem(),
+                      const size_t max_local_handoffs = 64)
+      : topology_(std::move(topology)),
+        max_local_handoffs_(max_local_handoffs) {
+    for (size_t i = 0; i < topology_.GetNodeCount(); ++i) {
+      nodes_.push_back(NewNodeState());
+    }
+  }
+
+ private:
+  static NodeStatePtr NewNodeState() {
+    void* memory_ = nullptr;
+    if (posix_memalign(&memory_, kCacheLineSize, sizeof(NodeState)) != 0) {
+      throw std::bad_alloc();
+    }
+    return NodeStatePtr{new (memory_) NodeState{}};
+  }
+
+  NodeState& GetCurrentNodeState() {
+    return *nodes_[topology_.GetCurrentNode()];
+  }
+
+  // ticket lock, may be released by another thread of the same node
+
+  void AcquireGlobal() {
+    const size_t this_thread_ticket = next_free_ticket_.fetch_add(1);
+    Backoff backoff{};
+    while (this_thread_ticket != owner_ticket_.load()) {
+      contention::Count(contention::kSpinIterations);
+      backoff();
+    }
+  }
+
+  void ReleaseGlobal() {
+    owner_ticket_.store(owner_ticket_.load() + 1);
+  }
+
  private:
-  // tail of intrusive list of LockGuards
-  tpcc::atomic<LockGuard*> wait_queue_tail_{nullptr};
+  NumaTopology topology_;
+  const size_t max_local_handoffs_;
+  std::vector<NodeStatePtr> nodes_;
+  tpcc::atomic<size_t> next_free_ticket_{0};
+  tpcc::atomic<size_t> owner_ticket_{0};
 };
 
 }  // namespace solutions
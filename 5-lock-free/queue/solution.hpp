@@ -1,15 +1,257 @@
 #pragma once
 
+#include "contention.hpp"
+
 #include <tpcc/stdlike/atomic.hpp>
 #include <tpcc/support/compiler.hpp>
 #include <tpcc/concurrency/backoff.hpp>
 
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <utility>
 #include <iostream>
+#include <vector>
 
 namespace tpcc {
 namespace solutions {
 
+// Epoch-based memory reclamation
+//
+// Every operation runs inside a Guard, which publishes the global epoch
+// observed on entry. The global epoch advances only when all active guards
+// have observed it. A node is tagged with the global epoch at the moment
+// it is retired; anyone who can still reach it entered in that epoch or
+// earlier and keeps the global epoch within one step of its own, so the
+// node is freed once the global epoch is two steps past the tag
+
+template <typename Node>
+class EpochDomain {
+  // retire list size that triggers an attempt to advance the global epoch
+  static const size_t kRetireThreshold = 64;
+
+  struct RetiredNode {
+    Node* node_;
+    size_t epoch_;
+  };
+
+  // Each thread owns one record per domain, registered on its first
+  // operation. At thread exit the record is released for reuse and its
+  // pending nodes are handed over to the orphan list
+  struct ThreadRecord {
+    tpcc::atomic<bool> in_use_{false};
+    tpcc::atomic<bool> active_{false};
+    tpcc::atomic<size_t> epoch_{0};
+    // epoch tags are non-decreasing
+    std::vector<RetiredNode> retired_;
+    ThreadRecord* next_{nullptr};
+  };
+
+  // Shared with the threads that have records here, they may exit after
+  // the domain is destroyed
+  struct Registry {
+    ~Registry() {
+      ThreadRecord* record_ = records_.load();
+      while (record_ != nullptr) {
+        FreeAll(record_->retired_);
+        ThreadRecord* next_ = record_->next_;
+        delete record_;
+        record_ = next_;
+      }
+      FreeAll(orphans_);
+    }
+
+    tpcc::atomic<ThreadRecord*> records_{nullptr};
+    std::mutex orphans_mutex_;
+    std::vector<RetiredNode> orphans_;
+  };
+
+  struct Lease {
+    uint64_t domain_id_;
+    std::weak_ptr<Registry> registry_;
+    ThreadRecord* record_;
+  };
+
+  struct ThreadLeases {
+    ~ThreadLeases() {
+      for (Lease& lease_ : leases_) {
+        if (auto registry_ = lease_.registry_.lock()) {
+          ReleaseRecord(*registry_, lease_.record_);
+        }
+      }
+    }
+
+    std::vector<Lease> leases_;
+  };
+
+ public:
+  class Guard {
+   public:
+    explicit Guard(EpochDomain& domain)
+        : domain_(domain), record_(domain.Enter()) {
+    }
+
+    ~Guard() {
+      domain_.Exit(record_);
+    }
+
+    // node must be already unreachable for operations started after this call
+    void Retire(Node* node) {
+      domain_.Retire(record_, node);
+    }
+
+   private:
+    EpochDomain& domain_;
+    ThreadRecord* record_;
+  };
+
+  EpochDomain()
+      : id_(NextDomainId()), registry_(std::make_shared<Registry>()) {
+  }
+
+ private:
+  ThreadRecord* Enter() {
+    ThreadRecord* record_ = GetThreadRecord();
+    size_t epoch_;
+    // published epoch must be current, otherwise the global epoch
+    // could run two steps ahead of us
+    do {
+      epoch_ = global_epoch_.load();
+      record_->epoch_.store(epoch_);
+      record_->active_.store(true);
+    } while (global_epoch_.load() != epoch_);
+
+    FreeExpired(record_->retired_, epoch_);
+    return record_;
+  }
+
+  void Exit(ThreadRecord* record) {
+    record->active_.store(false);
+  }
+
+  void Retire(ThreadRecord* record, Node* node) {
+    record->retired_.push_back(RetiredNode{node, global_epoch_.load()});
+    if (record->retired_.size() % kRetireThreshold == 0) {
+      TryAdvanceEpoch();
+    }
+  }
+
+  void TryAdvanceEpoch() {
+    size_t epoch_ = global_epoch_.load();
+    for (ThreadRecord* record_ = registry_->records_.load();
+         record_ != nullptr; record_ = record_->next_) {
+      if (record_->active_.load() && record_->epoch_.load() != epoch_) {
+        return void();
+      }
+    }
+    if (global_epoch_.compare_exchange_strong(epoch_, epoch_ + 1)) {
+      FreeExpiredOrphans(epoch_ + 1);
+    }
+  }
+
+  ThreadRecord* GetThreadRecord() {
+    static thread_local ThreadLeases thread_leases_;
+    for (const Lease& lease_ : thread_leases_.leases_) {
+      if (lease_.domain_id_ == id_) {
+        return lease_.record_;
+      }
+    }
+    // forget domains that are gone
+    auto& leases_ = thread_leases_.leases_;
+    for (size_t i = 0; i < leases_.size();) {
+      if (leases_[i].registry_.expired()) {
+        leases_[i] = std::move(leases_.back());
+        leases_.pop_back();
+      } else {
+        ++i;
+      }
+    }
+    ThreadRecord* record_ = AcquireRecord();
+    leases_.push_back(Lease{id_, registry_, record_});
+    return record_;
+  }
+
+  // once per thread
+  ThreadRecord* AcquireRecord() {
+    for (ThreadRecord* record_ = registry_->records_.load();
+         record_ != nullptr; record_ = record_->next_) {
+      bool free_ = false;
+      if (!record_->in_use_.load() &&
+          record_->in_use_.compare_exchange_strong(free_, true)) {
+        return record_;
+      }
+    }
+    ThreadRecord* new_record_ = new ThreadRecord{};
+    new_record_->in_use_.store(true);
+    ThreadRecord* head_ = registry_->records_.load();
+    do {
+      new_record_->next_ = head_;
+    } while (!registry_->records_.compare_exchange_weak(head_, new_record_));
+    return new_record_;
+  }
+
+  static void ReleaseRecord(Registry& registry, ThreadRecord* record) {
+    {
+      std::lock_guard<std::mutex> guard(registry.orphans_mutex_);
+      registry.orphans_.insert(registry.orphans_.end(),
+                               record->retired_.begin(),
+                               record->retired_.end());
+    }
+    record->retired_.clear();
+    record->in_use_.store(false);
+  }
+
+  // nodes left by exited threads, collected by whoever advances the epoch
+  void FreeExpiredOrphans(const size_t epoch) {
+    std::unique_lock<std::mutex> lock(registry_->orphans_mutex_,
+                                      std::try_to_lock);
+    if (!lock.owns_lock()) {
+      return void();
+    }
+    auto& orphans_ = registry_->orphans_;
+    size_t kept_ = 0;
+    for (size_t i = 0; i < orphans_.size(); ++i) {
+      if (orphans_[i].epoch_ + 2 <= epoch) {
+        delete orphans_[i].node_;
+      } else {
+        orphans_[kept_++] = orphans_[i];
+      }
+    }
+    orphans_.resize(kept_);
+  }
+
+  static void FreeExpired(std::vector<RetiredNode>& retired,
+                          const size_t epoch) {
+    size_t expired_ = 0;
+    while (expired_ < retired.size() &&
+           retired[expired_].epoch_ + 2 <= epoch) {
+      delete retired[expired_].node_;
+      ++expired_;
+    }
+    retired.erase(retired.begin(), retired.begin() + expired_);
+  }
+
+  static void FreeAll(std::vector<RetiredNode>& retired) {
+    for (RetiredNode& retired_node_ : retired) {
+      delete retired_node_.node_;
+    }
+    retired.clear();
+  }
+
+  static uint64_t NextDomainId() {
+    static tpcc::atomic<uint64_t> next_id_{0};
+    return next_id_.fetch_add(1);
+  }
+
+ private:
+  const uint64_t id_;
+  tpcc::atomic<size_t> global_epoch_{0};
+  std::shared_ptr<Registry> registry_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
 template <typename T>
 class LockFreeQueue {
   struct Node {
@@ -24,78 +266,172 @@ class LockFreeQueue {
     }
   };
 
+  using Reclaimer = EpochDomain<Node>;
+  using ReclaimGuard = typename Reclaimer::Guard;
+
  public:
   LockFreeQueue() {
     Node* dummy = new Node{};
     head_ = dummy;
     tail_ = dummy;
-    waste_head_ = dummy;
   }
 
   ~LockFreeQueue() {
-    while (waste_head_ != tail_.load()) {
-      Node* item_to_delete_ = waste_head_;
-      waste_head_ = waste_head_->next_;
+    Node* current_ = head_.load();
+    while (current_ != nullptr) {
+      Node* item_to_delete_ = current_;
+      current_ = current_->next_;
       delete item_to_delete_;
     }
-    delete tail_.load();
   }
 
   void Enqueue(T item) {
-    ++deals_with_queue_;
-    Node* new_element_ = new Node(item);
-    Node* current_tail_ = tail_.load();
-    Node* null_ptr_ = null_ptr_;
+    Node* new_element_ = new Node(std::move(item));
+    ReclaimGuard guard_{reclaimer_};
     while (true) {
-      if (current_tail_->next_ == nullptr) {
-        if (current_tail_->next_.compare_exchange_strong(null_ptr_,
+      Node* current_tail_ = tail_.load();
+      Node* next_ = current_tail_->next_.load();
+      if (next_ == nullptr) {
+        if (current_tail_->next_.compare_exchange_strong(next_,
                                                          new_element_)) {
-          break;
+          tail_.compare_exchange_strong(current_tail_, new_element_);
+          return void();
         }
+        contention::Count(contention::kCasRetries);
       } else {
-        tail_.compare_exchange_weak(current_tail_, current_tail_->next_);
+        // help the enqueuer that has not swung the tail yet
+        contention::Count(contention::kCasRetries);
+        tail_.compare_exchange_weak(current_tail_, next_);
       }
     }
-    tail_.compare_exchange_strong(current_tail_, new_element_);
-    --deals_with_queue_;
   }
 
   bool Dequeue(T& item) {
-    ++deals_with_queue_;
+    ReclaimGuard guard_{reclaimer_};
     while (true) {
-      Node* current_tail_ = tail_.load();
       Node* current_head_ = head_.load();
+      Node* current_tail_ = tail_.load();
+      Node* next_ = current_head_->next_.load();
       if (current_head_ == current_tail_) {
-        if (current_head_->next_ == nullptr) {
-          --deals_with_queue_;
+        if (next_ == nullptr) {
           return false;
         } else {
-          tail_.compare_exchange_weak(current_head_, current_tail_->next_);
+          contention::Count(contention::kCasRetries);
+          tail_.compare_exchange_weak(current_tail_, next_);
         }
       } else {
-        if (head_.compare_exchange_strong(current_head_,
-                                          current_head_->next_)) {
-          item = std::move(current_head_->next_.load()->item_);
-          if (deals_with_queue_.load() == 1) {
-            while (waste_head_ != current_head_) {
-              Node* item_to_delete_ = waste_head_;
-              waste_head_ = waste_head_->next_;
-              delete item_to_delete_;
-            }
-          }
-          --deals_with_queue_;
+        if (head_.compare_exchange_strong(current_head_, next_)) {
+          item = std::move(next_->item_);
+          guard_.Retire(current_head_);
           return true;
         }
+        contention::Count(contention::kCasRetries);
       }
     }
   }
 
  private:
-  tpcc::atomic<size_t> deals_with_queue_{0};
-  Node* waste_head_{nullptr};
+  Reclaimer reclaimer_;
   tpcc::atomic<Node*> head_{nullptr};
   tpcc::atomic<Node*> tail_{nullptr};
 };
 
+////////////////////////////////////////////////////////////////////////////////
+
+// Bounded array-based MPMC queue with per-slot sequence numbers
+//
+// Has the same Enqueue/Dequeue shape as LockFreeQueue but never allocates
+// after construction. Slot i is ready for the enqueue with position p when
+// its sequence equals p and for the dequeue with position p when it
+// equals p + 1
+
+template <typename T>
+class BoundedLockFreeQueue {
+  static const size_t kCacheLineSize = 64;
+
+  struct Slot {
+    tpcc::atomic<size_t> sequence_{0};
+    T item_;
+  };
+
+ public:
+  // capacity is rounded up to a power of two
+  explicit BoundedLockFreeQueue(const size_t capacity = 1024)
+      : mask_(RoundUpToPowerOfTwo(capacity) - 1), slots_(mask_ + 1) {
+    for (size_t i = 0; i < slots_.size(); ++i) {
+      slots_[i].sequence_.store(i);
+    }
+  }
+
+  // waits while queue is full
+  void Enqueue(T item) {
+    Backoff backoff{};
+    while (!TryEnqueue(item)) {
+      contention::Count(contention::kSpinIterations);
+      backoff();
+    }
+  }
+
+  // returns false iff queue is full, item is left untouched in that case
+  bool TryEnqueue(T& item) {
+    size_t position_ = tail_.load();
+    while (true) {
+      Slot& slot_ = slots_[position_ & mask_];
+      size_t sequence_ = slot_.sequence_.load();
+      if (sequence_ == position_) {
+        if (tail_.compare_exchange_weak(position_, position_ + 1)) {
+          slot_.item_ = std::move(item);
+          slot_.sequence_.store(position_ + 1);
+          return true;
+        }
+        contention::Count(contention::kCasRetries);
+      } else if (sequence_ < position_) {
+        return false;
+      } else {
+        position_ = tail_.load();
+      }
+    }
+  }
+
+  bool Dequeue(T& item) {
+    size_t position_ = head_.load();
+    while (true) {
+      Slot& slot_ = slots_[position_ & mask_];
+      size_t sequence_ = slot_.sequence_.load();
+      if (sequence_ == position_ + 1) {
+        if (head_.compare_exchange_weak(position_, position_ + 1)) {
+          item = std::move(slot_.item_);
+          slot_.sequence_.store(position_ + mask_ + 1);
+          return true;
+        }
+        contention::Count(contention::kCasRetries);
+      } else if (sequence_ < position_ + 1) {
+        return false;
+      } else {
+        position_ = head_.load();
+      }
+    }
+  }
+
+  size_t GetCapacity() const {
+    return mask_ + 1;
+  }
+
+ private:
+  static size_t RoundUpToPowerOfTwo(const size_t value) {
+    size_t power_ = 1;
+    while (power_ < value) {
+      power_ <<= 1;
+    }
+    return power_;
+  }
+
+ private:
+  const size_t mask_;
+  std::vector<Slot> slots_;
+  alignas(kCacheLineSize) tpcc::atomic<size_t> head_{0};
+  alignas(kCacheLineSize) tpcc::atomic<size_t> tail_{0};
+};
+
 }  // namespace solutions
 }  // namespace tpcc
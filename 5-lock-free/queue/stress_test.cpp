@@ -0,0 +1,73 @@
+// Multi-producer / multi-consumer stress test for LockFreeQueue, meant to
+// be run under AddressSanitizer to catch premature reclamation:
+//
+//   g++ -std=c++14 -O1 -g -fsanitize=address -pthread -I<tpcc include dir>
+//       stress_test.cpp -o stress_test
+//   ./stress_test
+
+#include "solution.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const size_t kProducers = 4;
+const size_t kConsumers = 4;
+const size_t kItemsPerProducer = 200000;
+const size_t kRounds = 5;
+
+// strings own heap memory, so reading a freed node's item is visible
+// to the sanitizer
+bool RunRound() {
+  tpcc::solutions::LockFreeQueue<std::string> queue_;
+  std::atomic<size_t> consumed_{0};
+  std::atomic<size_t> checksum_{0};
+
+  std::vector<std::thread> threads_;
+  for (size_t producer_ = 0; producer_ < kProducers; ++producer_) {
+    threads_.emplace_back([&]() {
+      for (size_t i = 1; i <= kItemsPerProducer; ++i) {
+        queue_.Enqueue(std::to_string(i));
+      }
+    });
+  }
+  for (size_t consumer_ = 0; consumer_ < kConsumers; ++consumer_) {
+    threads_.emplace_back([&]() {
+      std::string item_;
+      size_t local_sum_ = 0;
+      while (consumed_.load() < kProducers * kItemsPerProducer) {
+        if (queue_.Dequeue(item_)) {
+          local_sum_ += std::stoul(item_);
+          consumed_.fetch_add(1);
+        }
+      }
+      checksum_.fetch_add(local_sum_);
+    });
+  }
+  for (auto& thread_ : threads_) {
+    thread_.join();
+  }
+
+  std::string item_;
+  const size_t expected_ =
+      kProducers * kItemsPerProducer * (kItemsPerProducer + 1) / 2;
+  return !queue_.Dequeue(item_) && checksum_.load() == expected_;
+}
+
+}  // namespace
+
+int main() {
+  for (size_t round_ = 0; round_ < kRounds; ++round_) {
+    if (!RunRound()) {
+      std::fprintf(stderr, "round %zu: lost or duplicated items\n", round_);
+      return EXIT_FAILURE;
+    }
+  }
+  std::puts("OK");
+  return EXIT_SUCCESS;
+}
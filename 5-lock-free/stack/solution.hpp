@@ -1,72 +1,417 @@
 #pragma once
 
+#include "contention.hpp"
+
 #include <tpcc/stdlike/atomic.hpp>
 #include <tpcc/support/compiler.hpp>
 
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <utility>
+#include <vector>
 
 namespace tpcc {
 namespace solutions {
 
+// Elimination array: a Push and a Pop that both lost the race for top_
+// meet in a random slot and exchange the node directly.
+// The number of slots in use grows when offers collide and shrinks when
+// they time out without a partner
+
+template <typename Node>
+class EliminationArray {
+  static const size_t kCapacity = 16;
+  static const size_t kWaitIterations = 128;
+  static const size_t kCacheLineSize = 64;
+
+  struct alignas(kCacheLineSize) Slot {
+    tpcc::atomic<Node*> offer_{nullptr};
+  };
+
+ public:
+  // returns true iff some Pop has taken the node
+  bool TryEliminatePush(Node* node) {
+    Slot& slot_ = PickSlot();
+    Node* empty_ = nullptr;
+    if (!slot_.offer_.compare_exchange_strong(empty_, node)) {
+      // collided with another offer
+      contention::Count(contention::kCasRetries);
+      Grow();
+      return false;
+    }
+    for (size_t i = 0; i < kWaitIterations; ++i) {
+      if (slot_.offer_.load() == Taken()) {
+        slot_.offer_.store(nullptr);
+        return true;
+      }
+    }
+    Node* offered_ = node;
+    if (slot_.offer_.compare_exchange_strong(offered_, nullptr)) {
+      Shrink();
+      return false;
+    }
+    // taken while we were withdrawing
+    slot_.offer_.store(nullptr);
+    return true;
+  }
+
+  // returns node offered by some Push or nullptr
+  Node* TryEliminatePop() {
+    Slot& slot_ = PickSlot();
+    Node* offered_ = slot_.offer_.load();
+    if (offered_ == nullptr || offered_ == Taken()) {
+      Shrink();
+      return nullptr;
+    }
+    if (slot_.offer_.compare_exchange_strong(offered_, Taken())) {
+      return offered_;
+    }
+    contention::Count(contention::kCasRetries);
+    Grow();
+    return nullptr;
+  }
+
+ private:
+  // slot is released by the pusher after it has seen this mark,
+  // so the offered node can be recycled without ABA on the slot
+  static Node* Taken() {
+    return reinterpret_cast<Node*>(uintptr_t{1});
+  }
+
+  Slot& PickSlot() {
+    return slots_[NextRandom() % range_.load()];
+  }
+
+  void Grow() {
+    size_t range_size_ = range_.load();
+    if (range_size_ < kCapacity) {
+      range_.compare_exchange_strong(range_size_, range_size_ + 1);
+    }
+  }
+
+  void Shrink() {
+    size_t range_size_ = range_.load();
+    if (range_size_ > 1) {
+      range_.compare_exchange_strong(range_size_, range_size_ - 1);
+    }
+  }
+
+  static uint32_t NextRandom() {
+    static thread_local uint32_t state_ = 0x9E3779B9u;
+    state_ ^= state_ << 13;
+    state_ ^= state_ >> 17;
+    state_ ^= state_ << 5;
+    return state_;
+  }
+
+ private:
+  std::array<Slot, kCapacity> slots_;
+  tpcc::atomic<size_t> range_{1};
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Pointer with a modification counter packed into the unused upper bits
+// of the address, so a CAS fails if the node was popped and pushed back
+// in between (ABA)
+//
+// Relies on user-space addresses fitting into 48 bits, as on x86-64 with
+// 4-level paging and on AArch64 without tagged pointers. It is not valid
+// with 5-level paging (LA57) once the kernel hands out addresses above
+// 2^47, nor with top-byte tags (TBI/MTE); the constructor asserts that no
+// address bits are lost
+
+template <typename Node>
+class TaggedPointer {
+  static const size_t kTagShift = 48;
+  static const uintptr_t kPointerMask = (uintptr_t{1} << kTagShift) - 1;
+
+  static_assert(sizeof(uintptr_t) == 8,
+                "TaggedPointer needs 64-bit pointers with 16 spare bits");
+
+ public:
+  TaggedPointer() = default;
+
+  TaggedPointer(Node* ptr, const uintptr_t tag)
+      : word_((reinterpret_cast<uintptr_t>(ptr) & kPointerMask) |
+              (tag << kTagShift)) {
+    assert((reinterpret_cast<uintptr_t>(ptr) & ~kPointerMask) == 0);
+  }
+
+  Node* Get() const {
+    return reinterpret_cast<Node*>(word_ & kPointerMask);
+  }
+
+  uintptr_t GetTag() const {
+    return word_ >> kTagShift;
+  }
+
+  // same slot pointing to another node
+  TaggedPointer Replace(Node* ptr) const {
+    return {ptr, GetTag() + 1};
+  }
+
+ private:
+  uintptr_t word_{0};
+};
+
+// Intrusive Treiber stack over Node::next with a tagged top
+
+template <typename Node>
+class TaggedStack {
+  using Top = TaggedPointer<Node>;
+
+ public:
+  // single attempt, returns false iff lost the race for top
+  bool TryPush(Node* node) {
+    Top current_top_ = top_.load();
+    node->next.store(current_top_.Get());
+    return top_.compare_exchange_strong(current_top_,
+                                        current_top_.Replace(node));
+  }
+
+  // single attempt, returns false iff lost the race for top,
+  // node is nullptr if stack is empty
+  bool TryPop(Node*& node) {
+    Top current_top_ = top_.load();
+    node = current_top_.Get();
+    if (node == nullptr) {
+      return true;
+    }
+    // node may be recycled concurrently, but it is never freed
+    // and the tag makes the CAS fail in that case
+    return top_.compare_exchange_strong(
+        current_top_, current_top_.Replace(node->next.load()));
+  }
+
+  void Push(Node* node) {
+    while (!TryPush(node)) {
+      contention::Count(contention::kCasRetries);
+    }
+  }
+
+  // pushes nodes first..last already linked through next
+  void PushChain(Node* first, Node* last) {
+    Top current_top_ = top_.load();
+    while (true) {
+      last->next.store(current_top_.Get());
+      if (top_.compare_exchange_weak(current_top_,
+                                     current_top_.Replace(first))) {
+        return void();
+      }
+      contention::Count(contention::kCasRetries);
+    }
+  }
+
+  // detaches the whole stack, returns its top or nullptr if empty
+  Node* PopAll() {
+    Top current_top_ = top_.load();
+    while (current_top_.Get() != nullptr) {
+      if (top_.compare_exchange_weak(current_top_,
+                                     current_top_.Replace(nullptr))) {
+        return current_top_.Get();
+      }
+      contention::Count(contention::kCasRetries);
+    }
+    return nullptr;
+  }
+
+  Node* Pop() {
+    Node* node_;
+    while (!TryPop(node_)) {
+      contention::Count(contention::kCasRetries);
+    }
+    return node_;
+  }
+
+ private:
+  tpcc::atomic<Top> top_{Top{}};
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
 // Treiber lock-free stack
+//
+// Popped nodes are kept for reuse by subsequent Pushes, so the stack
+// holds at most as many nodes as it ever had items plus pushes in
+// progress and per-thread spares. Every thread keeps up to
+// kCacheCapacity spare nodes of its own. A full cache moves half of
+// them to the shared free list with one CAS, and an empty one takes the
+// whole shared list with one CAS, so the free list top is touched once
+// per batch rather than once per operation
 
 template <typename T>
 class LockFreeStack {
   struct Node {
     T item_;
-    std::atomic<Node*> next;
+    std::atomic<Node*> next{nullptr};
 
     Node(T item) : item_(std::move(item)) {
     }
   };
 
-  void ContinuePush(Node* new_top, tpcc::atomic<Node*>& top) {
-    auto current_top = top.load();
-    do {
-      new_top->next.store(current_top);
-    } while (!top.compare_exchange_strong(current_top, new_top));
-  }
+  static const size_t kCacheCapacity = 32;
+
+  // outlives the stack while some exiting thread gives its spares back
+  struct SharedFreeList {
+    ~SharedFreeList() {
+      DeleteAll(nodes_);
+    }
+
+    TaggedStack<Node> nodes_;
+  };
+
+  struct NodeCache {
+    uint64_t stack_id_;
+    std::weak_ptr<SharedFreeList> free_list_;
+    std::vector<Node*> nodes_;
+  };
+
+  struct ThreadCaches {
+    ~ThreadCaches() {
+      for (NodeCache& cache_ : caches_) {
+        ReleaseCache(cache_);
+      }
+    }
+
+    std::vector<NodeCache> caches_;
+  };
 
  public:
-  LockFreeStack() = default;
+  LockFreeStack()
+      : id_(NextStackId()), free_list_(std::make_shared<SharedFreeList>()) {
+  }
 
   ~LockFreeStack() {
-    /*T item_;
-    while (Pop(item_))
-      ;*/
-    Node* trash_top_ = trash_list_top_.load();
-    trash_list_top_.store(nullptr);
-    while (trash_top_ != nullptr) {
-      Node* old_node_ = trash_top_;
-      trash_top_ = trash_top_->next;
-      delete old_node_;
-    }
-    while (top_.load() != nullptr) {
-      Node* old_node_ = top_.load();
-      top_.store(old_node_->next);
-      delete old_node_;
-    }
+    DeleteAll(stack_);
   }
 
   void Push(T item) {
-    Node* new_top_ = new Node(item);
-    ContinuePush(new_top_, top_);
+    Node* new_top_ = AllocateNode(std::move(item));
+    while (true) {
+      if (stack_.TryPush(new_top_)) {
+        return void();
+      }
+      contention::Count(contention::kCasRetries);
+      if (elimination_.TryEliminatePush(new_top_)) {
+        return void();
+      }
+    }
   }
 
   bool Pop(T& item) {
-    Node* old_top_ = top_.load();
-    do {
-      if (old_top_ == nullptr)
-        return false;
-    } while (!top_.compare_exchange_strong(old_top_, old_top_->next));
-    item = old_top_->item_;
-    ContinuePush(old_top_, trash_list_top_);
-    return true;
+    while (true) {
+      Node* old_top_;
+      if (stack_.TryPop(old_top_)) {
+        if (old_top_ == nullptr) {
+          return false;
+        }
+      } else {
+        contention::Count(contention::kCasRetries);
+        old_top_ = elimination_.TryEliminatePop();
+      }
+      if (old_top_ != nullptr) {
+        item = std::move(old_top_->item_);
+        RecycleNode(old_top_);
+        return true;
+      }
+    }
+  }
+
+ private:
+  Node* AllocateNode(T item) {
+    std::vector<Node*>& cache_ = GetThreadCache();
+    if (cache_.empty()) {
+      for (Node* node_ = free_list_->nodes_.PopAll(); node_ != nullptr;
+           node_ = node_->next.load()) {
+        cache_.push_back(node_);
+      }
+    }
+    if (cache_.empty()) {
+      return new Node(std::move(item));
+    }
+    Node* node_ = cache_.back();
+    cache_.pop_back();
+    node_->item_ = std::move(item);
+    return node_;
+  }
+
+  void RecycleNode(Node* node) {
+    std::vector<Node*>& cache_ = GetThreadCache();
+    cache_.push_back(node);
+    if (cache_.size() > kCacheCapacity) {
+      const size_t keep_ = cache_.size() / 2;
+      PushChain(free_list_->nodes_, cache_, keep_);
+      cache_.resize(keep_);
+    }
+  }
+
+  std::vector<Node*>& GetThreadCache() {
+    static thread_local ThreadCaches thread_caches_;
+    auto& caches_ = thread_caches_.caches_;
+    for (NodeCache& cache_ : caches_) {
+      if (cache_.stack_id_ == id_) {
+        return cache_.nodes_;
+      }
+    }
+    // drop caches of destroyed stacks
+    for (size_t i = 0; i < caches_.size();) {
+      if (caches_[i].free_list_.expired()) {
+        ReleaseCache(caches_[i]);
+        caches_[i] = std::move(caches_.back());
+        caches_.pop_back();
+      } else {
+        ++i;
+      }
+    }
+    caches_.push_back(NodeCache{id_, free_list_, {}});
+    return caches_.back().nodes_;
+  }
+
+  // spares go back to the stack, or are freed if it is gone
+  static void ReleaseCache(NodeCache& cache) {
+    if (auto free_list_ = cache.free_list_.lock()) {
+      PushChain(free_list_->nodes_, cache.nodes_, 0);
+    } else {
+      for (Node* node_ : cache.nodes_) {
+        delete node_;
+      }
+    }
+    cache.nodes_.clear();
+  }
+
+  // links nodes[from..] and pushes them with a single CAS
+  static void PushChain(TaggedStack<Node>& stack, std::vector<Node*>& nodes,
+                        const size_t from) {
+    if (from >= nodes.size()) {
+      return void();
+    }
+    for (size_t i = from; i + 1 < nodes.size(); ++i) {
+      nodes[i]->next.store(nodes[i + 1]);
+    }
+    stack.PushChain(nodes[from], nodes.back());
+  }
+
+  static void DeleteAll(TaggedStack<Node>& stack) {
+    Node* node_;
+    while ((node_ = stack.Pop()) != nullptr) {
+      delete node_;
+    }
+  }
+
+  static uint64_t NextStackId() {
+    static tpcc::atomic<uint64_t> next_id_{0};
+    return next_id_.fetch_add(1);
   }
 
  private:
-  tpcc::atomic<Node*> top_{nullptr};
-  tpcc::atomic<Node*> trash_list_top_{nullptr};
+  const uint64_t id_;
+  TaggedStack<Node> stack_;
+  std::shared_ptr<SharedFreeList> free_list_;
+  EliminationArray<Node> elimination_;
 };
 
 }  // namespace solutions
@@ -0,0 +1,470 @@
+#pragma once
+
+#include "contention.hpp"
+
+#include <tpcc/concurrency/futex.hpp>
+#include <tpcc/stdlike/atomic.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace tpcc {
+namespace solutions {
+
+namespace detail {
+
+// plain new doesn't honour extended alignment before C++17
+
+template <typename T>
+struct AlignedDeleter {
+  void operator()(T* object) const {
+    object->~T();
+    std::free(object);
+  }
+};
+
+template <typename T>
+using AlignedPtr = std::unique_ptr<T, AlignedDeleter<T>>;
+
+template <typename T>
+AlignedPtr<T> MakeAligned() {
+  const size_t alignment_ = std::max(alignof(T), sizeof(void*));
+  void* memory_ = nullptr;
+  if (posix_memalign(&memory_, alignment_, sizeof(T)) != 0) {
+    throw std::bad_alloc();
+  }
+  return AlignedPtr<T>{new (memory_) T{}};
+}
+
+}  // namespace detail
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Chase-Lev deque: the owner pushes and takes at the bottom, thieves
+// steal from the top. Only the last element is contended, owner and
+// thief resolve it with a CAS on top_. The buffer grows on overflow;
+// old buffers may still be read by thieves, so they are kept until the
+// deque dies
+
+template <typename T>
+class WorkStealingDeque {
+  static const size_t kInitialCapacity = 64;
+
+  struct Buffer {
+    explicit Buffer(size_t capacity) : mask_(capacity - 1), items_(capacity) {
+    }
+
+    size_t GetCapacity() const {
+      return mask_ + 1;
+    }
+
+    T* Get(int64_t index) const {
+      return items_[static_cast<size_t>(index) & mask_].load();
+    }
+
+    void Put(int64_t index, T* item) {
+      items_[static_cast<size_t>(index) & mask_].store(item);
+    }
+
+    const size_t mask_;
+    std::vector<tpcc::atomic<T*>> items_;
+  };
+
+ public:
+  WorkStealingDeque() {
+    buffers_.emplace_back(new Buffer(kInitialCapacity));
+    buffer_.store(buffers_.back().get());
+  }
+
+  // owner only
+  void Push(T* item) {
+    const int64_t bottom_now_ = bottom_.load();
+    const int64_t top_now_ = top_.load();
+    Buffer* buffer_now_ = buffer_.load();
+    if (bottom_now_ - top_now_ >=
+        static_cast<int64_t>(buffer_now_->GetCapacity())) {
+      buffer_now_ = Grow(buffer_now_, top_now_, bottom_now_);
+    }
+    buffer_now_->Put(bottom_now_, item);
+    bottom_.store(bottom_now_ + 1);
+  }
+
+  // owner only, returns nullptr if empty
+  T* Take() {
+    const int64_t bottom_now_ = bottom_.load() - 1;
+    Buffer* buffer_now_ = buffer_.load();
+    bottom_.store(bottom_now_);
+    int64_t top_now_ = top_.load();
+    if (top_now_ > bottom_now_) {
+      bottom_.store(bottom_now_ + 1);
+      return nullptr;
+    }
+    T* item_ = buffer_now_->Get(bottom_now_);
+    if (top_now_ == bottom_now_) {
+      // the last item, race with thieves for it
+      if (!top_.compare_exchange_strong(top_now_, top_now_ + 1)) {
+        contention::Count(contention::kCasRetries);
+        item_ = nullptr;
+      }
+      bottom_.store(bottom_now_ + 1);
+    }
+    return item_;
+  }
+
+  // any thread, returns nullptr if empty or lost the race
+  T* Steal() {
+    int64_t top_now_ = top_.load();
+    const int64_t bottom_now_ = bottom_.load();
+    if (top_now_ >= bottom_now_) {
+      return nullptr;
+    }
+    T* item_ = buffer_.load()->Get(top_now_);
+    if (!top_.compare_exchange_strong(top_now_, top_now_ + 1)) {
+      contention::Count(contention::kCasRetries);
+      return nullptr;
+    }
+    return item_;
+  }
+
+  bool IsEmpty() const {
+    return top_.load() >= bottom_.load();
+  }
+
+ private:
+  Buffer* Grow(Buffer* old_buffer, int64_t top, int64_t bottom) {
+    buffers_.emplace_back(new Buffer(old_buffer->GetCapacity() * 2));
+    Buffer* new_buffer_ = buffers_.back().get();
+    for (int64_t i = top; i < bottom; ++i) {
+      new_buffer_->Put(i, old_buffer->Get(i));
+    }
+    buffer_.store(new_buffer_);
+    return new_buffer_;
+  }
+
+ private:
+  alignas(64) tpcc::atomic<int64_t> top_{0};
+  alignas(64) tpcc::atomic<int64_t> bottom_{0};
+  tpcc::atomic<Buffer*> buffer_{nullptr};
+  // owner only
+  std::vector<std::unique_ptr<Buffer>> buffers_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Each worker runs tasks from the bottom of its own deque and, when it
+// runs dry, takes external submissions or steals from a random victim.
+// Idle workers park on a futex; Submit wakes one only if somebody sleeps.
+// Tasks must not throw. The destructor runs all submitted tasks and
+// joins the workers. Deques are over-aligned, so they are allocated
+// with detail::MakeAligned
+
+class WorkStealingScheduler {
+  using Task = std::function<void()>;
+
+  static const size_t kStealAttempts = 4;
+
+ public:
+  explicit WorkStealingScheduler(
+      const size_t num_workers = std::thread::hardware_concurrency())
+      : wakeups_futex_(wakeups_), groups_done_futex_(groups_done_) {
+    const size_t workers_count_ = num_workers > 0 ? num_workers : 1;
+    for (size_t i = 0; i < workers_count_; ++i) {
+      deques_.push_back(detail::MakeAligned<WorkStealingDeque<Task>>());
+    }
+    for (size_t i = 0; i < workers_count_; ++i) {
+      workers_.emplace_back([this, i]() { WorkerRoutine(i); });
+    }
+  }
+
+  ~WorkStealingScheduler() {
+    stopped_.store(true);
+    ++wakeups_;
+    wakeups_futex_.WakeAll();
+    for (auto& worker_ : workers_) {
+      worker_.join();
+    }
+  }
+
+  WorkStealingScheduler(const WorkStealingScheduler&) = delete;
+  WorkStealingScheduler& operator=(const WorkStealingScheduler&) = delete;
+
+  // from a worker goes to its own deque, otherwise to the shared queue
+  void Submit(Task task) {
+    Task* task_ = new Task(std::move(task));
+    WorkerContext& context_ = GetContext();
+    if (context_.scheduler_ == this) {
+      deques_[context_.index_]->Push(task_);
+    } else {
+      std::lock_guard<std::mutex> guard(injection_mutex_);
+      injected_.push_back(task_);
+      injected_count_.fetch_add(1);
+    }
+    WakeIdleWorker();
+  }
+
+  size_t GetWorkerCount() const {
+    return workers_.size();
+  }
+
+  ////////////////////////////////////////////////////////////////////////////
+
+  // Tasks spawned by one fork-join scope. On a worker Wait runs pending
+  // tasks while the group is not done, so nested waits inside tasks don't
+  // block workers; any other thread parks until the last task of the
+  // group wakes it
+
+  class TaskGroup {
+   public:
+    explicit TaskGroup(WorkStealingScheduler& scheduler)
+        : scheduler_(scheduler) {
+    }
+
+    ~TaskGroup() {
+      Wait();
+    }
+
+    // the group may be gone once pending_ drops to zero, so the last
+    // task reaches the scheduler through its own copy of the pointer
+    template <class F>
+    void Spawn(F&& function) {
+      pending_.fetch_add(1);
+      scheduler_.Submit([this, scheduler = &scheduler_,
+                         function = std::forward<F>(function)]() mutable {
+        function();
+        if (pending_.fetch_sub(1) == 1) {
+          scheduler->NotifyGroupWaiters();
+        }
+      });
+    }
+
+    void Wait() {
+      if (!scheduler_.IsWorkerThread()) {
+        scheduler_.WaitGroup(pending_);
+        return void();
+      }
+      while (pending_.load() > 0) {
+        if (!scheduler_.RunOneTask()) {
+          contention::Count(contention::kSpinIterations);
+          std::this_thread::yield();
+        }
+      }
+    }
+
+   private:
+    WorkStealingScheduler& scheduler_;
+    tpcc::atomic<size_t> pending_{0};
+  };
+
+  // runs both functions, possibly in parallel
+  template <class F1, class F2>
+  void ParallelInvoke(F1&& first, F2&& second) {
+    TaskGroup group_(*this);
+    group_.Spawn(std::forward<F2>(second));
+    first();
+    group_.Wait();
+  }
+
+  // calls body(i) for i in [begin, end), splitting the range in halves
+  // down to grain_size so idle workers steal large chunks first
+  template <class F>
+  void ParallelFor(size_t begin, size_t end, const F& body,
+                   const size_t grain_size = 1) {
+    TaskGroup group_(*this);
+    SplitRange(group_, begin, end, body, grain_size > 0 ? grain_size : 1);
+    group_.Wait();
+  }
+
+ private:
+  struct WorkerContext {
+    WorkStealingScheduler* scheduler_{nullptr};
+    size_t index_{0};
+    // xorshift state for picking victims, never zero
+    uint32_t random_state_{0x9E3779B9u};
+  };
+
+  static WorkerContext& GetContext() {
+    static thread_local WorkerContext context_;
+    return context_;
+  }
+
+  bool IsWorkerThread() const {
+    return GetContext().scheduler_ == this;
+  }
+
+  // the same handshake as Park, on the count of finished groups
+  void WaitGroup(const tpcc::atomic<size_t>& pending) {
+    group_waiters_.fetch_add(1);
+    while (true) {
+      const uint32_t groups_done_now_ = groups_done_.load();
+      if (pending.load() == 0) {
+        break;
+      }
+      contention::WaitTimer wait_timer_;
+      groups_done_futex_.Wait(groups_done_now_);
+    }
+    group_waiters_.fetch_sub(1);
+  }
+
+  void NotifyGroupWaiters() {
+    ++groups_done_;
+    if (group_waiters_.load() > 0) {
+      contention::Count(contention::kUnparks);
+      groups_done_futex_.WakeAll();
+    }
+  }
+
+  template <class F>
+  void SplitRange(TaskGroup& group, size_t begin, size_t end, const F& body,
+                  const size_t grain_size) {
+    while (end - begin > grain_size) {
+      const size_t middle_ = begin + (end - begin) / 2;
+      group.Spawn([this, &group, middle_, end, &body, grain_size]() {
+        SplitRange(group, middle_, end, body, grain_size);
+      });
+      end = middle_;
+    }
+    for (size_t i = begin; i < end; ++i) {
+      body(i);
+    }
+  }
+
+  void WorkerRoutine(const size_t index) {
+    WorkerContext& context_ = GetContext();
+    context_.scheduler_ = this;
+    context_.index_ = index;
+    // distinct seeds, so workers don't probe victims in lockstep
+    context_.random_state_ =
+        (0x9E3779B9u * static_cast<uint32_t>(index + 1)) | 1u;
+
+    while (true) {
+      if (RunOneTask()) {
+        continue;
+      }
+      if (stopped_.load()) {
+        break;
+      }
+      Park();
+    }
+  }
+
+  // returns false if no task was found
+  bool RunOneTask() {
+    Task* task_ = FindTask();
+    if (task_ == nullptr) {
+      return false;
+    }
+    (*task_)();
+    delete task_;
+    return true;
+  }
+
+  Task* FindTask() {
+    WorkerContext& context_ = GetContext();
+    const bool is_worker_ = context_.scheduler_ == this;
+    if (is_worker_) {
+      if (Task* task_ = deques_[context_.index_]->Take()) {
+        return task_;
+      }
+    }
+    if (Task* task_ = TakeInjected()) {
+      return task_;
+    }
+    for (size_t attempt_ = 0; attempt_ < kStealAttempts * deques_.size();
+         ++attempt_) {
+      const size_t victim_ = NextRandom(context_) % deques_.size();
+      if (is_worker_ && victim_ == context_.index_) {
+        continue;
+      }
+      if (Task* task_ = deques_[victim_]->Steal()) {
+        return task_;
+      }
+    }
+    return nullptr;
+  }
+
+  Task* TakeInjected() {
+    if (injected_count_.load() == 0) {
+      return nullptr;
+    }
+    std::lock_guard<std::mutex> guard(injection_mutex_);
+    if (injected_.empty()) {
+      return nullptr;
+    }
+    Task* task_ = injected_.front();
+    injected_.pop_front();
+    injected_count_.fetch_sub(1);
+    return task_;
+  }
+
+  bool HasWork() const {
+    if (injected_count_.load() > 0) {
+      return true;
+    }
+    for (const auto& deque_ : deques_) {
+      if (!deque_->IsEmpty()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // sleepers_ is raised before the last look for work, and Submit
+  // publishes the task before reading sleepers_, so no wake-up is lost
+  void Park() {
+    const uint32_t wakeups_now_ = wakeups_.load();
+    sleepers_.fetch_add(1);
+    if (!HasWork() && !stopped_.load()) {
+      contention::WaitTimer wait_timer_;
+      wakeups_futex_.Wait(wakeups_now_);
+    }
+    sleepers_.fetch_sub(1);
+  }
+
+  void WakeIdleWorker() {
+    if (sleepers_.load() > 0) {
+      ++wakeups_;
+      contention::Count(contention::kUnparks);
+      wakeups_futex_.WakeOne();
+    }
+  }
+
+  static uint32_t NextRandom(WorkerContext& context) {
+    uint32_t& state_ = context.random_state_;
+    state_ ^= state_ << 13;
+    state_ ^= state_ >> 17;
+    state_ ^= state_ << 5;
+    return state_;
+  }
+
+ private:
+  std::vector<detail::AlignedPtr<WorkStealingDeque<Task>>> deques_;
+  std::vector<std::thread> workers_;
+
+  std::mutex injection_mutex_;
+  std::deque<Task*> injected_;
+  tpcc::atomic<size_t> injected_count_{0};
+
+  std::atomic<uint32_t> wakeups_{0};
+  tpcc::atomic<size_t> sleepers_{0};
+  tpcc::atomic<bool> stopped_{false};
+  tpcc::Futex wakeups_futex_;
+
+  // external threads waiting for task groups
+  std::atomic<uint32_t> groups_done_{0};
+  tpcc::atomic<size_t> group_waiters_{0};
+  tpcc::Futex groups_done_futex_;
+};
+
+}  // namespace solutions
+}  // namespace tpcc
@@ -0,0 +1,14 @@
+#include "lock_bench.hpp"
+
+#include "../1-mutex/futex/solution.hpp"
+
+namespace tpcc {
+namespace bench {
+
+BenchResult RunAdaptiveLock(const BenchConfig& config) {
+  LockUnlockAdapter<solutions::AdaptiveLock> lock_;
+  return RunBench(lock_, config);
+}
+
+}  // namespace bench
+}  // namespace tpcc
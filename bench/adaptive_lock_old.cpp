@@ -0,0 +1,14 @@
+#include "lock_bench.hpp"
+
+#include "legacy/adaptive_lock.hpp"
+
+namespace tpcc {
+namespace bench {
+
+BenchResult RunLegacyAdaptiveLock(const BenchConfig& config) {
+  LockUnlockAdapter<legacy::AdaptiveLock> lock_;
+  return RunBench(lock_, config);
+}
+
+}  // namespace bench
+}  // namespace tpcc
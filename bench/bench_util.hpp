@@ -0,0 +1,191 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Helpers shared by the benchmark executables: command line parsing,
+// thread count grids, busy work and a fixed-duration throughput runner
+
+namespace tpcc {
+namespace bench {
+
+inline std::vector<std::string> SplitList(const std::string& list) {
+  std::vector<std::string> items_;
+  size_t begin_ = 0;
+  while (begin_ <= list.size()) {
+    size_t end_ = list.find(',', begin_);
+    if (end_ == std::string::npos) {
+      end_ = list.size();
+    }
+    if (end_ > begin_) {
+      items_.push_back(list.substr(begin_, end_ - begin_));
+    }
+    begin_ = end_ + 1;
+  }
+  return items_;
+}
+
+inline std::vector<size_t> ParseNumbers(const std::string& list) {
+  std::vector<size_t> numbers_;
+  for (const std::string& item_ : SplitList(list)) {
+    numbers_.push_back(std::stoul(item_));
+  }
+  return numbers_;
+}
+
+[[noreturn]] inline void Usage(const char* argument, const char* usage) {
+  std::fprintf(stderr, "unknown argument: %s\n", argument);
+  std::fprintf(stderr, "usage: %s\n", usage);
+  std::exit(EXIT_FAILURE);
+}
+
+// Splits --key=value arguments, exits with the usage line on anything else
+inline std::vector<std::pair<std::string, std::string>> ParseKeyValues(
+    int argc, char** argv, const char* usage) {
+  std::vector<std::pair<std::string, std::string>> arguments_;
+  for (int i = 1; i < argc; ++i) {
+    const std::string argument_ = argv[i];
+    const size_t equals_ = argument_.find('=');
+    if (argument_.compare(0, 2, "--") != 0 || equals_ == std::string::npos) {
+      Usage(argv[i], usage);
+    }
+    arguments_.emplace_back(argument_.substr(2, equals_ - 2),
+                            argument_.substr(equals_ + 1));
+  }
+  return arguments_;
+}
+
+inline bool IsSelected(const std::vector<std::string>& selected,
+                       const std::string& name) {
+  return selected.empty() ||
+         std::find(selected.begin(), selected.end(), name) != selected.end();
+}
+
+inline size_t GetHardwareThreads() {
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// explicit counts, or powers of two up to the number of hardware threads,
+// plus hardware_threads * factor for every oversubscription factor
+inline std::vector<size_t> GetThreadCounts(
+    const std::vector<size_t>& threads,
+    const std::vector<size_t>& oversubscription,
+    const size_t hardware_threads) {
+  std::set<size_t> counts_(threads.begin(), threads.end());
+  if (threads.empty()) {
+    for (size_t count_ = 1; count_ < hardware_threads; count_ *= 2) {
+      counts_.insert(count_);
+    }
+    counts_.insert(hardware_threads);
+  }
+  for (size_t factor_ : oversubscription) {
+    if (factor_ > 0) {
+      counts_.insert(hardware_threads * factor_);
+    }
+  }
+  return {counts_.begin(), counts_.end()};
+}
+
+namespace detail {
+
+inline int64_t NowNanoseconds() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// the result is kept, so the loop can't be optimized away
+inline uint64_t BusyWork(const size_t iterations, uint64_t state) {
+  for (size_t i = 0; i < iterations; ++i) {
+    state = state * 6364136223846793005ull + 1442695040888963407ull;
+  }
+  return state;
+}
+
+inline uint64_t Percentile(std::vector<uint64_t>& samples,
+                           const double fraction) {
+  if (samples.empty()) {
+    return 0;
+  }
+  const size_t index_ = std::min(
+      samples.size() - 1, static_cast<size_t>(samples.size() * fraction));
+  std::nth_element(samples.begin(), samples.begin() + index_, samples.end());
+  return samples[index_];
+}
+
+inline uint64_t NextRandom(uint64_t& state) {
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return state;
+}
+
+}  // namespace detail
+
+struct ThroughputResult {
+  double seconds_{0};
+  uint64_t operations_{0};
+};
+
+// Calls operation(thread_index, random_state) in a loop on every thread
+// for the given duration and counts the calls. random_state is a
+// per-thread xorshift state seeded from the thread index
+
+template <class Operation>
+ThroughputResult RunThroughput(const size_t threads,
+                               const std::chrono::milliseconds duration,
+                               Operation operation) {
+  std::vector<uint64_t> operations_(threads, 0);
+  std::atomic<size_t> ready_{0};
+  std::atomic<bool> started_{false};
+  std::atomic<bool> stopped_{false};
+
+  std::vector<std::thread> workers_;
+  for (size_t index_ = 0; index_ < threads; ++index_) {
+    workers_.emplace_back([&, index_]() {
+      uint64_t random_ = 0x9E3779B97F4A7C15ull * (index_ + 1);
+      uint64_t count_ = 0;
+      ready_.fetch_add(1);
+      while (!started_.load()) {
+        std::this_thread::yield();
+      }
+      while (!stopped_.load(std::memory_order_relaxed)) {
+        operation(index_, random_);
+        ++count_;
+      }
+      operations_[index_] = count_;
+    });
+  }
+
+  while (ready_.load() < threads) {
+    std::this_thread::yield();
+  }
+  const auto start_ = std::chrono::steady_clock::now();
+  started_.store(true);
+  std::this_thread::sleep_for(duration);
+  stopped_.store(true);
+  for (auto& worker_ : workers_) {
+    worker_.join();
+  }
+  const auto finish_ = std::chrono::steady_clock::now();
+
+  ThroughputResult result_;
+  result_.seconds_ = std::chrono::duration<double>(finish_ - start_).count();
+  for (uint64_t count_ : operations_) {
+    result_.operations_ += count_;
+  }
+  return result_;
+}
+
+}  // namespace bench
+}  // namespace tpcc
@@ -0,0 +1,216 @@
+// Condition variable broadcast benchmark: waiters block on a condition
+// variable under a shared mutex, then one NotifyAll releases them all.
+// Measures the time from the notify to each waiter getting the mutex,
+// the time until the last one gets it, and the context switches of the
+// waiters from their first wait to getting the mutex back. Compares
+// ConditionVariable with wait morphing (FutexMutex), its wake-all
+// fallback (std::mutex) and std::condition_variable, and prints one CSV
+// row per run to stdout.
+//
+//   cond_var_bench [--variants=morphing,wake_all,std] [--waiters=64]
+//                  [--rounds=20]
+
+#include "bench_util.hpp"
+
+#include "../2-cond-var/cond-var/solution.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <sys/resource.h>
+
+namespace {
+
+struct BroadcastConfig {
+  size_t waiters_{64};
+  size_t rounds_{20};
+};
+
+struct BroadcastResult {
+  // notify to mutex acquisition, over all waiters of all rounds
+  uint64_t wakeup_p50_ns_{0};
+  uint64_t wakeup_p99_ns_{0};
+  // notify to the last waiter getting the mutex, averaged over rounds
+  uint64_t last_wakeup_ns_{0};
+  // per round, summed over the waiters
+  double voluntary_switches_{0};
+  double involuntary_switches_{0};
+};
+
+using tpcc::solutions::ConditionVariable;
+
+template <class Mutex>
+void Wait(ConditionVariable& cond_var, std::unique_lock<Mutex>& lock) {
+  cond_var.Wait(*lock.mutex());
+}
+
+void Wait(std::condition_variable& cond_var,
+          std::unique_lock<std::mutex>& lock) {
+  cond_var.wait(lock);
+}
+
+void NotifyAll(ConditionVariable& cond_var) {
+  cond_var.NotifyAll();
+}
+
+void NotifyAll(std::condition_variable& cond_var) {
+  cond_var.notify_all();
+}
+
+// voluntary and involuntary context switches of the calling thread
+std::pair<long, long> GetThreadSwitches() {
+  struct rusage usage_;
+  getrusage(RUSAGE_THREAD, &usage_);
+  return {usage_.ru_nvcsw, usage_.ru_nivcsw};
+}
+
+template <class Mutex, class CondVar>
+BroadcastResult RunBroadcast(const BroadcastConfig& config) {
+  using tpcc::bench::detail::NowNanoseconds;
+
+  std::vector<uint64_t> wakeup_ns_;
+  uint64_t last_wakeup_ns_ = 0;
+  long voluntary_ = 0;
+  long involuntary_ = 0;
+
+  for (size_t round_ = 0; round_ < config.rounds_; ++round_) {
+    Mutex mutex_;
+    CondVar cond_var_;
+    size_t waiting_ = 0;
+    bool go_ = false;
+    int64_t notify_ns_ = 0;
+    std::vector<int64_t> acquired_ns_(config.waiters_, 0);
+    std::vector<std::pair<long, long>> switches_(config.waiters_);
+
+    std::vector<std::thread> waiters_;
+    for (size_t index_ = 0; index_ < config.waiters_; ++index_) {
+      waiters_.emplace_back([&, index_]() {
+        std::unique_lock<Mutex> lock_(mutex_);
+        const std::pair<long, long> before_ = GetThreadSwitches();
+        ++waiting_;
+        while (!go_) {
+          Wait(cond_var_, lock_);
+        }
+        acquired_ns_[index_] = NowNanoseconds();
+        const std::pair<long, long> after_ = GetThreadSwitches();
+        switches_[index_] = {after_.first - before_.first,
+                             after_.second - before_.second};
+      });
+    }
+
+    // every waiter counted itself and released the mutex in Wait
+    while (true) {
+      {
+        std::lock_guard<Mutex> guard_(mutex_);
+        if (waiting_ == config.waiters_) {
+          go_ = true;
+          notify_ns_ = NowNanoseconds();
+          break;
+        }
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    NotifyAll(cond_var_);
+    for (auto& waiter_ : waiters_) {
+      waiter_.join();
+    }
+
+    int64_t last_ns_ = notify_ns_;
+    for (size_t i = 0; i < config.waiters_; ++i) {
+      wakeup_ns_.push_back(
+          static_cast<uint64_t>(acquired_ns_[i] - notify_ns_));
+      last_ns_ = std::max(last_ns_, acquired_ns_[i]);
+      voluntary_ += switches_[i].first;
+      involuntary_ += switches_[i].second;
+    }
+    last_wakeup_ns_ += static_cast<uint64_t>(last_ns_ - notify_ns_);
+  }
+
+  BroadcastResult result_;
+  const size_t rounds_ = std::max<size_t>(config.rounds_, 1);
+  using tpcc::bench::detail::Percentile;
+  result_.wakeup_p50_ns_ = Percentile(wakeup_ns_, 0.5);
+  result_.wakeup_p99_ns_ = Percentile(wakeup_ns_, 0.99);
+  result_.last_wakeup_ns_ = last_wakeup_ns_ / rounds_;
+  result_.voluntary_switches_ = static_cast<double>(voluntary_) / rounds_;
+  result_.involuntary_switches_ = static_cast<double>(involuntary_) / rounds_;
+  return result_;
+}
+
+struct VariantEntry {
+  const char* name_;
+  BroadcastResult (*run_)(const BroadcastConfig&);
+};
+
+const VariantEntry kVariants[] = {
+    {"morphing",
+     &RunBroadcast<tpcc::solutions::FutexMutex, ConditionVariable>},
+    {"wake_all", &RunBroadcast<std::mutex, ConditionVariable>},
+    {"std", &RunBroadcast<std::mutex, std::condition_variable>},
+};
+
+struct Options {
+  std::vector<std::string> variants_;
+  std::vector<size_t> waiters_{64};
+  size_t rounds_{20};
+};
+
+const char* const kUsage =
+    "cond_var_bench [--variants=a,b] [--waiters=n,m] [--rounds=n]";
+
+Options ParseOptions(int argc, char** argv) {
+  Options options_;
+  for (const auto& argument_ :
+       tpcc::bench::ParseKeyValues(argc, argv, kUsage)) {
+    const std::string& key_ = argument_.first;
+    const std::string& value_ = argument_.second;
+    if (key_ == "variants") {
+      options_.variants_ = tpcc::bench::SplitList(value_);
+    } else if (key_ == "waiters") {
+      options_.waiters_ = tpcc::bench::ParseNumbers(value_);
+    } else if (key_ == "rounds") {
+      options_.rounds_ = std::stoul(value_);
+    } else {
+      tpcc::bench::Usage(key_.c_str(), kUsage);
+    }
+  }
+  return options_;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const Options options_ = ParseOptions(argc, argv);
+
+  std::printf(
+      "variant,waiters,rounds,wakeup_p50_ns,wakeup_p99_ns,last_wakeup_ns,"
+      "voluntary_switches_per_round,involuntary_switches_per_round\n");
+
+  for (const VariantEntry& variant_ : kVariants) {
+    if (!tpcc::bench::IsSelected(options_.variants_, variant_.name_)) {
+      continue;
+    }
+    for (size_t waiters_ : options_.waiters_) {
+      BroadcastConfig config_;
+      config_.waiters_ = waiters_;
+      config_.rounds_ = options_.rounds_;
+      const BroadcastResult result_ = variant_.run_(config_);
+      std::printf("%s,%zu,%zu,%llu,%llu,%llu,%.1f,%.1f\n", variant_.name_,
+                  waiters_, config_.rounds_,
+                  static_cast<unsigned long long>(result_.wakeup_p50_ns_),
+                  static_cast<unsigned long long>(result_.wakeup_p99_ns_),
+                  static_cast<unsigned long long>(result_.last_wakeup_ns_),
+                  result_.voluntary_switches_, result_.involuntary_switches_);
+      std::fflush(stdout);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,238 @@
+// StripedHashSet benchmark with integer keys: the set is filled with
+// every other key of the range, then threads run a mix of Contains and
+// Insert/Remove on random keys of the whole range, so about half of the
+// lookups hit. Compares the bucket storage policies under both stripe
+// locks and prints one CSV row per run to stdout with the throughput and
+// the heap bytes per element held after the fill. Thread counts run from
+// one to all hardware threads, so the all-read runs show read scaling.
+//
+//   hash_set_bench [--storages=flat,chained] [--locks=rw,distributed]
+//                  [--threads=1,2,4] [--oversubscription=2]
+//                  [--keys=1024,1048576] [--reads=100,90,50] [--stripes=16]
+//                  [--duration-ms=200]
+
+#include "bench_util.hpp"
+
+#include "../3-fine-grained/hash-table/solution.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+
+// Heap usage is tracked by replacing the global allocation functions:
+// every block carries its size in a header in front of it
+
+namespace {
+
+const size_t kHeaderSize = alignof(std::max_align_t);
+
+std::atomic<int64_t> heap_bytes{0};
+
+void* Allocate(const size_t size) {
+  void* block_ = std::malloc(size + kHeaderSize);
+  if (block_ == nullptr) {
+    throw std::bad_alloc();
+  }
+  *static_cast<size_t*>(block_) = size;
+  heap_bytes.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed);
+  return static_cast<char*>(block_) + kHeaderSize;
+}
+
+void Deallocate(void* ptr) {
+  if (ptr == nullptr) {
+    return void();
+  }
+  void* block_ = static_cast<char*>(ptr) - kHeaderSize;
+  heap_bytes.fetch_sub(static_cast<int64_t>(*static_cast<size_t*>(block_)),
+                       std::memory_order_relaxed);
+  std::free(block_);
+}
+
+}  // namespace
+
+void* operator new(size_t size) {
+  return Allocate(size);
+}
+
+void* operator new[](size_t size) {
+  return Allocate(size);
+}
+
+void operator delete(void* ptr) noexcept {
+  Deallocate(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+  Deallocate(ptr);
+}
+
+void operator delete(void* ptr, size_t /*size*/) noexcept {
+  Deallocate(ptr);
+}
+
+void operator delete[](void* ptr, size_t /*size*/) noexcept {
+  Deallocate(ptr);
+}
+
+namespace {
+
+using tpcc::bench::ThroughputResult;
+
+struct SetConfig {
+  size_t threads_{1};
+  size_t keys_{1024};
+  // percentage of Contains, the rest is split between Insert and Remove
+  size_t reads_{100};
+  size_t stripes_{16};
+  std::chrono::milliseconds duration_{200};
+};
+
+struct SetResult {
+  ThroughputResult throughput_;
+  double bytes_per_element_{0};
+};
+
+template <template <typename, class> class Storage, class RWLock>
+SetResult RunSet(const SetConfig& config) {
+  const int64_t heap_before_ = heap_bytes.load();
+  tpcc::solutions::StripedHashSet<uint64_t, std::hash<uint64_t>, Storage,
+                                  RWLock>
+      set_(config.stripes_);
+  for (uint64_t key_ = 0; key_ < config.keys_; key_ += 2) {
+    set_.Insert(key_);
+  }
+
+  SetResult result_;
+  result_.bytes_per_element_ =
+      static_cast<double>(heap_bytes.load() - heap_before_) / set_.GetSize();
+  result_.throughput_ = tpcc::bench::RunThroughput(
+      config.threads_, config.duration_,
+      [&](size_t /*thread_index*/, uint64_t& random) {
+        const uint64_t draw_ = tpcc::bench::detail::NextRandom(random);
+        const uint64_t key_ = (draw_ >> 8) % config.keys_;
+        const size_t percent_ = draw_ % 100;
+        if (percent_ < config.reads_) {
+          random ^= set_.Contains(key_);
+        } else if (percent_ % 2 == 0) {
+          set_.Insert(key_);
+        } else {
+          set_.Remove(key_);
+        }
+      });
+  return result_;
+}
+
+struct SetEntry {
+  const char* storage_;
+  const char* lock_;
+  SetResult (*run_)(const SetConfig&);
+};
+
+using tpcc::solutions::ChainedBuckets;
+using tpcc::solutions::DistributedReaderWriterLock;
+using tpcc::solutions::FlatBuckets;
+using tpcc::solutions::ReaderWriterLock;
+
+const SetEntry kSets[] = {
+    {"flat", "rw", &RunSet<FlatBuckets, ReaderWriterLock>},
+    {"flat", "distributed", &RunSet<FlatBuckets, DistributedReaderWriterLock>},
+    {"chained", "rw", &RunSet<ChainedBuckets, ReaderWriterLock>},
+    {"chained", "distributed",
+     &RunSet<ChainedBuckets, DistributedReaderWriterLock>},
+};
+
+struct Options {
+  std::vector<std::string> storages_;
+  std::vector<std::string> locks_;
+  std::vector<size_t> threads_;
+  std::vector<size_t> oversubscription_{2};
+  std::vector<size_t> keys_{1024, 1048576};
+  std::vector<size_t> reads_{100, 90, 50};
+  size_t stripes_{16};
+  size_t duration_ms_{200};
+};
+
+const char* const kUsage =
+    "hash_set_bench [--storages=a,b] [--locks=a,b] [--threads=n,m] "
+    "[--oversubscription=k,l] [--keys=n,m] [--reads=p,q] [--stripes=n] "
+    "[--duration-ms=n]";
+
+Options ParseOptions(int argc, char** argv) {
+  using tpcc::bench::ParseNumbers;
+  Options options_;
+  for (const auto& argument_ :
+       tpcc::bench::ParseKeyValues(argc, argv, kUsage)) {
+    const std::string& key_ = argument_.first;
+    const std::string& value_ = argument_.second;
+    if (key_ == "storages") {
+      options_.storages_ = tpcc::bench::SplitList(value_);
+    } else if (key_ == "locks") {
+      options_.locks_ = tpcc::bench::SplitList(value_);
+    } else if (key_ == "threads") {
+      options_.threads_ = ParseNumbers(value_);
+    } else if (key_ == "oversubscription") {
+      options_.oversubscription_ = ParseNumbers(value_);
+    } else if (key_ == "keys") {
+      options_.keys_ = ParseNumbers(value_);
+    } else if (key_ == "reads") {
+      options_.reads_ = ParseNumbers(value_);
+    } else if (key_ == "stripes") {
+      options_.stripes_ = std::stoul(value_);
+    } else if (key_ == "duration-ms") {
+      options_.duration_ms_ = std::stoul(value_);
+    } else {
+      tpcc::bench::Usage(key_.c_str(), kUsage);
+    }
+  }
+  return options_;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const Options options_ = ParseOptions(argc, argv);
+  const size_t hardware_threads_ = tpcc::bench::GetHardwareThreads();
+
+  std::printf(
+      "storage,lock,threads,hardware_threads,keys,reads_percent,stripes,"
+      "seconds,operations,operations_per_s,bytes_per_element\n");
+
+  for (const SetEntry& set_ : kSets) {
+    if (!tpcc::bench::IsSelected(options_.storages_, set_.storage_) ||
+        !tpcc::bench::IsSelected(options_.locks_, set_.lock_)) {
+      continue;
+    }
+    for (size_t threads_ : tpcc::bench::GetThreadCounts(
+             options_.threads_, options_.oversubscription_,
+             hardware_threads_)) {
+      for (size_t keys_ : options_.keys_) {
+        for (size_t reads_ : options_.reads_) {
+          SetConfig config_;
+          config_.threads_ = threads_;
+          config_.keys_ = keys_;
+          config_.reads_ = reads_;
+          config_.stripes_ = options_.stripes_;
+          config_.duration_ =
+              std::chrono::milliseconds(options_.duration_ms_);
+          const SetResult result_ = set_.run_(config_);
+          const ThroughputResult& throughput_ = result_.throughput_;
+          std::printf("%s,%s,%zu,%zu,%zu,%zu,%zu,%.6f,%llu,%.1f,%.1f\n",
+                      set_.storage_, set_.lock_, threads_, hardware_threads_,
+                      keys_, reads_, options_.stripes_, throughput_.seconds_,
+                      static_cast<unsigned long long>(
+                          throughput_.operations_),
+                      throughput_.operations_ / throughput_.seconds_,
+                      result_.bytes_per_element_);
+          std::fflush(stdout);
+        }
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,209 @@
+// StripedHashSet growth benchmark: writer threads insert disjoint keys
+// into an empty set until it holds --keys elements, so the table grows
+// many times on the way, and every Insert is timed. Optional reader
+// threads look up random keys meanwhile. Compares the incremental
+// migration of both storages with the stop-the-world expansion of the
+// original set and prints one CSV row per run to stdout.
+//
+//   hash_set_growth_bench [--sets=legacy,chained,flat] [--writers=1,4]
+//                         [--readers=0,2] [--keys=1048576] [--stripes=16]
+
+#include "bench_util.hpp"
+
+#include "../3-fine-grained/hash-table/solution.hpp"
+#include "legacy/striped_hash_set.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct GrowthConfig {
+  size_t writers_{1};
+  size_t readers_{0};
+  size_t keys_{1048576};
+  size_t stripes_{16};
+};
+
+struct GrowthResult {
+  double seconds_{0};
+  uint64_t lookups_{0};
+  uint64_t insert_p50_ns_{0};
+  uint64_t insert_p99_ns_{0};
+  uint64_t insert_p999_ns_{0};
+  uint64_t insert_max_ns_{0};
+};
+
+template <class Set>
+GrowthResult RunGrowth(const GrowthConfig& config) {
+  using tpcc::bench::detail::NowNanoseconds;
+
+  Set set_(config.stripes_);
+  std::vector<std::vector<uint64_t>> insert_ns_(config.writers_);
+  std::vector<uint64_t> lookups_(config.readers_, 0);
+  std::atomic<size_t> ready_{0};
+  std::atomic<bool> started_{false};
+  std::atomic<bool> stopped_{false};
+  const size_t thread_count_ = config.writers_ + config.readers_;
+
+  std::vector<std::thread> threads_;
+  for (size_t index_ = 0; index_ < config.writers_; ++index_) {
+    threads_.emplace_back([&, index_]() {
+      std::vector<uint64_t>& samples_ = insert_ns_[index_];
+      samples_.reserve(config.keys_ / config.writers_ + 1);
+      ready_.fetch_add(1);
+      while (!started_.load()) {
+        std::this_thread::yield();
+      }
+      for (uint64_t key_ = index_; key_ < config.keys_;
+           key_ += config.writers_) {
+        const int64_t start_ns_ = NowNanoseconds();
+        set_.Insert(key_);
+        samples_.push_back(
+            static_cast<uint64_t>(NowNanoseconds() - start_ns_));
+      }
+    });
+  }
+  for (size_t index_ = 0; index_ < config.readers_; ++index_) {
+    threads_.emplace_back([&, index_]() {
+      uint64_t random_ = 0x9E3779B97F4A7C15ull * (index_ + 1);
+      uint64_t count_ = 0;
+      ready_.fetch_add(1);
+      while (!started_.load()) {
+        std::this_thread::yield();
+      }
+      while (!stopped_.load(std::memory_order_relaxed)) {
+        const uint64_t key_ =
+            tpcc::bench::detail::NextRandom(random_) % config.keys_;
+        random_ ^= set_.Contains(key_);
+        ++count_;
+      }
+      lookups_[index_] = count_;
+    });
+  }
+
+  while (ready_.load() < thread_count_) {
+    std::this_thread::yield();
+  }
+  const auto start_ = std::chrono::steady_clock::now();
+  started_.store(true);
+  for (size_t i = 0; i < config.writers_; ++i) {
+    threads_[i].join();
+  }
+  const auto finish_ = std::chrono::steady_clock::now();
+  stopped_.store(true);
+  for (size_t i = config.writers_; i < thread_count_; ++i) {
+    threads_[i].join();
+  }
+
+  GrowthResult result_;
+  result_.seconds_ = std::chrono::duration<double>(finish_ - start_).count();
+  for (uint64_t count_ : lookups_) {
+    result_.lookups_ += count_;
+  }
+  std::vector<uint64_t> samples_;
+  for (const auto& thread_samples_ : insert_ns_) {
+    samples_.insert(samples_.end(), thread_samples_.begin(),
+                    thread_samples_.end());
+  }
+  using tpcc::bench::detail::Percentile;
+  result_.insert_p50_ns_ = Percentile(samples_, 0.5);
+  result_.insert_p99_ns_ = Percentile(samples_, 0.99);
+  result_.insert_p999_ns_ = Percentile(samples_, 0.999);
+  result_.insert_max_ns_ = Percentile(samples_, 1.0);
+  return result_;
+}
+
+template <template <typename, class> class Storage>
+using IncrementalSet =
+    tpcc::solutions::StripedHashSet<uint64_t, std::hash<uint64_t>, Storage>;
+
+struct SetEntry {
+  const char* name_;
+  GrowthResult (*run_)(const GrowthConfig&);
+};
+
+const SetEntry kSets[] = {
+    {"legacy", &RunGrowth<tpcc::bench::legacy::StripedHashSet<uint64_t>>},
+    {"chained", &RunGrowth<IncrementalSet<tpcc::solutions::ChainedBuckets>>},
+    {"flat", &RunGrowth<IncrementalSet<tpcc::solutions::FlatBuckets>>},
+};
+
+struct Options {
+  std::vector<std::string> sets_;
+  std::vector<size_t> writers_{1, 4};
+  std::vector<size_t> readers_{0, 2};
+  size_t keys_{1048576};
+  size_t stripes_{16};
+};
+
+const char* const kUsage =
+    "hash_set_growth_bench [--sets=a,b] [--writers=n,m] [--readers=n,m] "
+    "[--keys=n] [--stripes=n]";
+
+Options ParseOptions(int argc, char** argv) {
+  using tpcc::bench::ParseNumbers;
+  Options options_;
+  for (const auto& argument_ :
+       tpcc::bench::ParseKeyValues(argc, argv, kUsage)) {
+    const std::string& key_ = argument_.first;
+    const std::string& value_ = argument_.second;
+    if (key_ == "sets") {
+      options_.sets_ = tpcc::bench::SplitList(value_);
+    } else if (key_ == "writers") {
+      options_.writers_ = ParseNumbers(value_);
+    } else if (key_ == "readers") {
+      options_.readers_ = ParseNumbers(value_);
+    } else if (key_ == "keys") {
+      options_.keys_ = std::stoul(value_);
+    } else if (key_ == "stripes") {
+      options_.stripes_ = std::stoul(value_);
+    } else {
+      tpcc::bench::Usage(key_.c_str(), kUsage);
+    }
+  }
+  return options_;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const Options options_ = ParseOptions(argc, argv);
+
+  std::printf(
+      "set,writers,readers,keys,stripes,seconds,lookups,insert_p50_ns,"
+      "insert_p99_ns,insert_p999_ns,insert_max_ns\n");
+
+  for (const SetEntry& set_ : kSets) {
+    if (!tpcc::bench::IsSelected(options_.sets_, set_.name_)) {
+      continue;
+    }
+    for (size_t writers_ : options_.writers_) {
+      for (size_t readers_ : options_.readers_) {
+        GrowthConfig config_;
+        config_.writers_ = std::max<size_t>(writers_, 1);
+        config_.readers_ = readers_;
+        config_.keys_ = options_.keys_;
+        config_.stripes_ = options_.stripes_;
+        const GrowthResult result_ = set_.run_(config_);
+        std::printf("%s,%zu,%zu,%zu,%zu,%.6f,%llu,%llu,%llu,%llu,%llu\n",
+                    set_.name_, config_.writers_, readers_, config_.keys_,
+                    config_.stripes_, result_.seconds_,
+                    static_cast<unsigned long long>(result_.lookups_),
+                    static_cast<unsigned long long>(result_.insert_p50_ns_),
+                    static_cast<unsigned long long>(result_.insert_p99_ns_),
+                    static_cast<unsigned long long>(result_.insert_p999_ns_),
+                    static_cast<unsigned long long>(result_.insert_max_ns_));
+        std::fflush(stdout);
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+// AdaptiveLock as it was before the three-state futex rewrite: every
+// acquirer registers in threads_in_queue_ and every contended release
+// wakes a waiter. Kept only as the baseline of lock_bench
+
+#include "futex_like.hpp"
+
+#include <tpcc/stdlike/atomic.hpp>
+
+#include <mutex>
+
+namespace tpcc {
+namespace bench {
+namespace legacy {
+
+class AdaptiveLock {
+ public:
+  AdaptiveLock() {
+  }
+
+  void Lock() {
+    threads_in_queue_.fetch_add(1);
+    while (lock_.exchange(true)) {
+      futex_.Wait(true);
+    }
+  }
+
+  void Unlock() {
+    lock_.store(false);
+    if (threads_in_queue_.fetch_sub(1) > 1) {
+      futex_.WakeOne();
+    }
+  }
+
+ private:
+  atomic<bool> lock_{false}, for_futex_{false};
+  atomic<size_t> threads_in_queue_{0};
+  solutions::FutexLike<bool> futex_{for_futex_};
+};
+
+}  // namespace legacy
+}  // namespace bench
+}  // namespace tpcc
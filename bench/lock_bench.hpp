@@ -0,0 +1,182 @@
+#pragma once
+
+#include "bench_util.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace tpcc {
+namespace bench {
+
+struct BenchConfig {
+  size_t threads_{1};
+  // iterations of busy work on data shared under the lock
+  size_t cs_iterations_{0};
+  // iterations of thread-local busy work between acquisitions
+  size_t think_iterations_{0};
+  std::chrono::milliseconds duration_{200};
+};
+
+struct BenchResult {
+  double seconds_{0};
+  uint64_t acquisitions_{0};
+  uint64_t min_thread_acquisitions_{0};
+  uint64_t max_thread_acquisitions_{0};
+  // standard deviation of per-thread acquisitions over their mean
+  double acquisitions_cv_{0};
+  // acquisitions that waited for a release by another thread
+  uint64_t handoffs_{0};
+  uint64_t handoff_p50_ns_{0};
+  uint64_t handoff_p99_ns_{0};
+  uint64_t handoff_p999_ns_{0};
+  bool mutual_exclusion_held_{true};
+};
+
+// One runner per lock, each in its own translation unit, so a change to
+// one solution header rebuilds only its runner
+
+BenchResult RunAdaptiveLock(const BenchConfig& config);
+BenchResult RunLegacyAdaptiveLock(const BenchConfig& config);
+BenchResult RunQueueSpinLock(const BenchConfig& config);
+BenchResult RunSpinLock(const BenchConfig& config);
+BenchResult RunStdMutex(const BenchConfig& config);
+BenchResult RunTicketLock(const BenchConfig& config);
+BenchResult RunTournamentTreeLock(const BenchConfig& config);
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Lock adapters run a callable inside the critical section:
+//   template <class F> void Run(F&& critical_section);
+
+template <class Lock>
+class LockUnlockAdapter {
+ public:
+  template <typename... Args>
+  explicit LockUnlockAdapter(Args&&... args)
+      : lock_(std::forward<Args>(args)...) {
+  }
+
+  template <class F>
+  void Run(F&& critical_section) {
+    lock_.Lock();
+    critical_section();
+    lock_.Unlock();
+  }
+
+ private:
+  Lock lock_;
+};
+
+// Threads acquire the lock in a loop for config.duration_. The owner
+// stamps the time right before releasing the lock; an acquirer that
+// started waiting before that stamp records the gap between the release
+// and its own acquisition as a handoff latency
+
+template <class LockAdapter>
+BenchResult RunBench(LockAdapter& lock, const BenchConfig& config) {
+  // keeps at most this many latency samples per thread
+  const size_t kMaxSamples = size_t{1} << 18;
+
+  struct ProtectedState {
+    uint64_t acquisitions_{0};
+    int64_t last_release_ns_{0};
+    uint64_t data_{0};
+  };
+
+  struct ThreadStats {
+    uint64_t acquisitions_{0};
+    std::vector<uint64_t> handoff_ns_;
+    uint64_t sink_{0};
+  };
+
+  ProtectedState protected_;
+  std::vector<ThreadStats> stats_(config.threads_);
+  std::atomic<size_t> ready_{0};
+  std::atomic<bool> started_{false};
+  std::atomic<bool> stopped_{false};
+
+  std::vector<std::thread> threads_;
+  for (size_t index_ = 0; index_ < config.threads_; ++index_) {
+    threads_.emplace_back([&, index_]() {
+      ThreadStats& stats_ref_ = stats_[index_];
+      uint64_t think_state_ = index_ + 1;
+      ready_.fetch_add(1);
+      while (!started_.load()) {
+        std::this_thread::yield();
+      }
+      while (!stopped_.load(std::memory_order_relaxed)) {
+        const int64_t request_ns_ = detail::NowNanoseconds();
+        lock.Run([&]() {
+          const int64_t acquired_ns_ = detail::NowNanoseconds();
+          if (protected_.last_release_ns_ > request_ns_ &&
+              stats_ref_.handoff_ns_.size() < kMaxSamples) {
+            stats_ref_.handoff_ns_.push_back(
+                static_cast<uint64_t>(acquired_ns_ -
+                                      protected_.last_release_ns_));
+          }
+          ++protected_.acquisitions_;
+          protected_.data_ =
+              detail::BusyWork(config.cs_iterations_, protected_.data_);
+          protected_.last_release_ns_ = detail::NowNanoseconds();
+        });
+        ++stats_ref_.acquisitions_;
+        think_state_ =
+            detail::BusyWork(config.think_iterations_, think_state_);
+      }
+      stats_ref_.sink_ = think_state_;
+    });
+  }
+
+  while (ready_.load() < config.threads_) {
+    std::this_thread::yield();
+  }
+  const auto start_ = std::chrono::steady_clock::now();
+  started_.store(true);
+  std::this_thread::sleep_for(config.duration_);
+  stopped_.store(true);
+  for (auto& thread_ : threads_) {
+    thread_.join();
+  }
+  const auto finish_ = std::chrono::steady_clock::now();
+
+  BenchResult result_;
+  result_.seconds_ = std::chrono::duration<double>(finish_ - start_).count();
+  result_.min_thread_acquisitions_ = stats_.front().acquisitions_;
+  std::vector<uint64_t> handoff_ns_;
+  for (const ThreadStats& stats_ref_ : stats_) {
+    result_.acquisitions_ += stats_ref_.acquisitions_;
+    result_.min_thread_acquisitions_ =
+        std::min(result_.min_thread_acquisitions_, stats_ref_.acquisitions_);
+    result_.max_thread_acquisitions_ =
+        std::max(result_.max_thread_acquisitions_, stats_ref_.acquisitions_);
+    handoff_ns_.insert(handoff_ns_.end(), stats_ref_.handoff_ns_.begin(),
+                       stats_ref_.handoff_ns_.end());
+  }
+
+  const double mean_ =
+      static_cast<double>(result_.acquisitions_) / config.threads_;
+  double variance_ = 0;
+  for (const ThreadStats& stats_ref_ : stats_) {
+    const double deviation_ = stats_ref_.acquisitions_ - mean_;
+    variance_ += deviation_ * deviation_ / config.threads_;
+  }
+  result_.acquisitions_cv_ = mean_ > 0 ? std::sqrt(variance_) / mean_ : 0;
+
+  result_.handoffs_ = handoff_ns_.size();
+  result_.handoff_p50_ns_ = detail::Percentile(handoff_ns_, 0.5);
+  result_.handoff_p99_ns_ = detail::Percentile(handoff_ns_, 0.99);
+  result_.handoff_p999_ns_ = detail::Percentile(handoff_ns_, 0.999);
+  result_.mutual_exclusion_held_ =
+      protected_.acquisitions_ == result_.acquisitions_;
+  return result_;
+}
+
+}  // namespace bench
+}  // namespace tpcc
@@ -0,0 +1,137 @@
+// Lock benchmark: runs every lock over a grid of thread counts,
+// critical section lengths and think times and prints one CSV row per
+// run to stdout.
+//
+//   lock_bench [--locks=ticket,queue,...] [--threads=1,2,4]
+//              [--oversubscription=2,4] [--cs=0,64,1024]
+//              [--think=0,256,4096] [--duration-ms=200]
+//
+// Thread counts default to powers of two up to the number of hardware
+// threads; every --oversubscription factor adds a run with that many
+// threads per hardware thread
+
+#include "lock_bench.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+
+using tpcc::bench::BenchConfig;
+using tpcc::bench::BenchResult;
+
+struct LockEntry {
+  const char* name_;
+  BenchResult (*run_)(const BenchConfig&);
+};
+
+const LockEntry kLocks[] = {
+    {"ticket", &tpcc::bench::RunTicketLock},
+    {"queue", &tpcc::bench::RunQueueSpinLock},
+    {"adaptive", &tpcc::bench::RunAdaptiveLock},
+    {"adaptive_old", &tpcc::bench::RunLegacyAdaptiveLock},
+    {"tournament", &tpcc::bench::RunTournamentTreeLock},
+    {"spin", &tpcc::bench::RunSpinLock},
+    {"std_mutex", &tpcc::bench::RunStdMutex},
+};
+
+struct Options {
+  std::vector<std::string> locks_;
+  std::vector<size_t> threads_;
+  std::vector<size_t> oversubscription_{2, 4};
+  std::vector<size_t> cs_iterations_{0, 64, 1024};
+  std::vector<size_t> think_iterations_{0, 256, 4096};
+  size_t duration_ms_{200};
+};
+
+const char* const kUsage =
+    "lock_bench [--locks=a,b] [--threads=n,m] [--oversubscription=k,l] "
+    "[--cs=n,m] [--think=n,m] [--duration-ms=n]";
+
+Options ParseOptions(int argc, char** argv) {
+  using tpcc::bench::ParseNumbers;
+  Options options_;
+  for (const auto& argument_ :
+       tpcc::bench::ParseKeyValues(argc, argv, kUsage)) {
+    const std::string& key_ = argument_.first;
+    const std::string& value_ = argument_.second;
+    if (key_ == "locks") {
+      options_.locks_ = tpcc::bench::SplitList(value_);
+    } else if (key_ == "threads") {
+      options_.threads_ = ParseNumbers(value_);
+    } else if (key_ == "oversubscription") {
+      options_.oversubscription_ = ParseNumbers(value_);
+    } else if (key_ == "cs") {
+      options_.cs_iterations_ = ParseNumbers(value_);
+    } else if (key_ == "think") {
+      options_.think_iterations_ = ParseNumbers(value_);
+    } else if (key_ == "duration-ms") {
+      options_.duration_ms_ = std::stoul(value_);
+    } else {
+      tpcc::bench::Usage(key_.c_str(), kUsage);
+    }
+  }
+  return options_;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const Options options_ = ParseOptions(argc, argv);
+  const size_t hardware_threads_ = tpcc::bench::GetHardwareThreads();
+
+  std::printf(
+      "lock,threads,hardware_threads,oversubscription,cs_iterations,"
+      "think_iterations,seconds,acquisitions,throughput_per_s,"
+      "min_thread_acquisitions,max_thread_acquisitions,acquisitions_cv,"
+      "handoffs,handoff_p50_ns,handoff_p99_ns,handoff_p999_ns\n");
+
+  bool mutual_exclusion_held_ = true;
+  for (const LockEntry& lock_ : kLocks) {
+    if (!tpcc::bench::IsSelected(options_.locks_, lock_.name_)) {
+      continue;
+    }
+    for (size_t threads_ : tpcc::bench::GetThreadCounts(
+             options_.threads_, options_.oversubscription_,
+             hardware_threads_)) {
+      for (size_t cs_iterations_ : options_.cs_iterations_) {
+        for (size_t think_iterations_ : options_.think_iterations_) {
+          BenchConfig config_;
+          config_.threads_ = threads_;
+          config_.cs_iterations_ = cs_iterations_;
+          config_.think_iterations_ = think_iterations_;
+          config_.duration_ =
+              std::chrono::milliseconds(options_.duration_ms_);
+          const BenchResult result_ = lock_.run_(config_);
+          if (!result_.mutual_exclusion_held_) {
+            std::fprintf(stderr, "%s: mutual exclusion violated\n",
+                         lock_.name_);
+            mutual_exclusion_held_ = false;
+          }
+          std::printf(
+              "%s,%zu,%zu,%.3f,%zu,%zu,%.6f,%llu,%.1f,%llu,%llu,%.4f,%llu,"
+              "%llu,%llu,%llu\n",
+              lock_.name_, threads_, hardware_threads_,
+              static_cast<double>(threads_) / hardware_threads_,
+              cs_iterations_, think_iterations_, result_.seconds_,
+              static_cast<unsigned long long>(result_.acquisitions_),
+              result_.acquisitions_ / result_.seconds_,
+              static_cast<unsigned long long>(
+                  result_.min_thread_acquisitions_),
+              static_cast<unsigned long long>(
+                  result_.max_thread_acquisitions_),
+              result_.acquisitions_cv_,
+              static_cast<unsigned long long>(result_.handoffs_),
+              static_cast<unsigned long long>(result_.handoff_p50_ns_),
+              static_cast<unsigned long long>(result_.handoff_p99_ns_),
+              static_cast<unsigned long long>(result_.handoff_p999_ns_));
+          std::fflush(stdout);
+        }
+      }
+    }
+  }
+  return mutual_exclusion_held_ ? EXIT_SUCCESS : EXIT_FAILURE;
+}
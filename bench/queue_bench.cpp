@@ -0,0 +1,178 @@
+// Queue benchmark: every thread enqueues the current time and dequeues
+// in a loop on top of a prefilled queue. Compares the bounded ring-buffer
+// queue with LockFreeQueue and prints one CSV row per run to stdout with
+// the throughput and the time items spent in the queue.
+//
+//   queue_bench [--queues=bounded,linked] [--threads=1,2,4]
+//               [--oversubscription=2] [--prefill=0,256]
+//               [--capacity=1024] [--duration-ms=200]
+
+#include "bench_util.hpp"
+
+#include "../5-lock-free/queue/solution.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace {
+
+using tpcc::bench::ThroughputResult;
+
+struct QueueResult {
+  ThroughputResult throughput_;
+  uint64_t latency_p50_ns_{0};
+  uint64_t latency_p99_ns_{0};
+  uint64_t latency_p999_ns_{0};
+};
+
+struct QueueConfig {
+  size_t threads_{1};
+  size_t prefill_{0};
+  size_t capacity_{1024};
+  std::chrono::milliseconds duration_{200};
+};
+
+// one operation is an Enqueue followed by a Dequeue
+template <class Queue>
+QueueResult RunQueue(Queue& queue, const QueueConfig& config) {
+  // keeps at most this many latency samples per thread
+  const size_t kMaxSamples = size_t{1} << 18;
+
+  std::vector<std::vector<uint64_t>> samples_(config.threads_);
+  for (size_t i = 0; i < config.prefill_; ++i) {
+    queue.Enqueue(tpcc::bench::detail::NowNanoseconds());
+  }
+
+  QueueResult result_;
+  result_.throughput_ = tpcc::bench::RunThroughput(
+      config.threads_, config.duration_,
+      [&](size_t thread_index, uint64_t& /*random*/) {
+        queue.Enqueue(tpcc::bench::detail::NowNanoseconds());
+        int64_t enqueued_ns_;
+        if (queue.Dequeue(enqueued_ns_)) {
+          std::vector<uint64_t>& thread_samples_ = samples_[thread_index];
+          if (thread_samples_.size() < kMaxSamples) {
+            thread_samples_.push_back(static_cast<uint64_t>(
+                tpcc::bench::detail::NowNanoseconds() - enqueued_ns_));
+          }
+        }
+      });
+
+  std::vector<uint64_t> latency_ns_;
+  for (const auto& thread_samples_ : samples_) {
+    latency_ns_.insert(latency_ns_.end(), thread_samples_.begin(),
+                       thread_samples_.end());
+  }
+  using tpcc::bench::detail::Percentile;
+  result_.latency_p50_ns_ = Percentile(latency_ns_, 0.5);
+  result_.latency_p99_ns_ = Percentile(latency_ns_, 0.99);
+  result_.latency_p999_ns_ = Percentile(latency_ns_, 0.999);
+  return result_;
+}
+
+QueueResult RunBoundedQueue(const QueueConfig& config) {
+  tpcc::solutions::BoundedLockFreeQueue<int64_t> queue_(config.capacity_);
+  return RunQueue(queue_, config);
+}
+
+QueueResult RunLinkedQueue(const QueueConfig& config) {
+  tpcc::solutions::LockFreeQueue<int64_t> queue_;
+  return RunQueue(queue_, config);
+}
+
+struct QueueEntry {
+  const char* name_;
+  QueueResult (*run_)(const QueueConfig&);
+};
+
+const QueueEntry kQueues[] = {
+    {"bounded", &RunBoundedQueue},
+    {"linked", &RunLinkedQueue},
+};
+
+struct Options {
+  std::vector<std::string> queues_;
+  std::vector<size_t> threads_;
+  std::vector<size_t> oversubscription_{2};
+  std::vector<size_t> prefill_{0, 256};
+  size_t capacity_{1024};
+  size_t duration_ms_{200};
+};
+
+const char* const kUsage =
+    "queue_bench [--queues=a,b] [--threads=n,m] [--oversubscription=k,l] "
+    "[--prefill=n,m] [--capacity=n] [--duration-ms=n]";
+
+Options ParseOptions(int argc, char** argv) {
+  using tpcc::bench::ParseNumbers;
+  Options options_;
+  for (const auto& argument_ :
+       tpcc::bench::ParseKeyValues(argc, argv, kUsage)) {
+    const std::string& key_ = argument_.first;
+    const std::string& value_ = argument_.second;
+    if (key_ == "queues") {
+      options_.queues_ = tpcc::bench::SplitList(value_);
+    } else if (key_ == "threads") {
+      options_.threads_ = ParseNumbers(value_);
+    } else if (key_ == "oversubscription") {
+      options_.oversubscription_ = ParseNumbers(value_);
+    } else if (key_ == "prefill") {
+      options_.prefill_ = ParseNumbers(value_);
+    } else if (key_ == "capacity") {
+      options_.capacity_ = std::stoul(value_);
+    } else if (key_ == "duration-ms") {
+      options_.duration_ms_ = std::stoul(value_);
+    } else {
+      tpcc::bench::Usage(key_.c_str(), kUsage);
+    }
+  }
+  return options_;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const Options options_ = ParseOptions(argc, argv);
+  const size_t hardware_threads_ = tpcc::bench::GetHardwareThreads();
+
+  std::printf(
+      "queue,threads,hardware_threads,prefill,capacity,seconds,"
+      "enqueue_dequeue_pairs,pairs_per_s,latency_p50_ns,latency_p99_ns,"
+      "latency_p999_ns\n");
+
+  for (const QueueEntry& queue_ : kQueues) {
+    if (!tpcc::bench::IsSelected(options_.queues_, queue_.name_)) {
+      continue;
+    }
+    for (size_t threads_ : tpcc::bench::GetThreadCounts(
+             options_.threads_, options_.oversubscription_,
+             hardware_threads_)) {
+      for (size_t prefill_ : options_.prefill_) {
+        QueueConfig config_;
+        config_.threads_ = threads_;
+        config_.prefill_ = prefill_;
+        // room for the prefill and one item in flight per thread
+        config_.capacity_ =
+            std::max(options_.capacity_, prefill_ + threads_);
+        config_.duration_ = std::chrono::milliseconds(options_.duration_ms_);
+        const QueueResult result_ = queue_.run_(config_);
+        const ThroughputResult& throughput_ = result_.throughput_;
+        std::printf("%s,%zu,%zu,%zu,%zu,%.6f,%llu,%.1f,%llu,%llu,%llu\n",
+                    queue_.name_, threads_, hardware_threads_, prefill_,
+                    config_.capacity_, throughput_.seconds_,
+                    static_cast<unsigned long long>(throughput_.operations_),
+                    throughput_.operations_ / throughput_.seconds_,
+                    static_cast<unsigned long long>(result_.latency_p50_ns_),
+                    static_cast<unsigned long long>(result_.latency_p99_ns_),
+                    static_cast<unsigned long long>(
+                        result_.latency_p999_ns_));
+        std::fflush(stdout);
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,30 @@
+#include "lock_bench.hpp"
+
+#include "../4-cache/queue-spinlock/solution.hpp"
+
+namespace tpcc {
+namespace bench {
+
+namespace {
+
+class QueueSpinLockAdapter {
+ public:
+  template <class F>
+  void Run(F&& critical_section) {
+    solutions::QueueSpinLock::LockGuard guard_(lock_);
+    critical_section();
+  }
+
+ private:
+  solutions::QueueSpinLock lock_;
+};
+
+}  // namespace
+
+BenchResult RunQueueSpinLock(const BenchConfig& config) {
+  QueueSpinLockAdapter lock_;
+  return RunBench(lock_, config);
+}
+
+}  // namespace bench
+}  // namespace tpcc
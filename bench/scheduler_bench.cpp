@@ -0,0 +1,312 @@
+// Scheduler benchmark: runs fork-join workloads on WorkStealingScheduler
+// and on a plain pool of workers fed by one BlockingQueue, and prints one
+// CSV row per run to stdout.
+//
+//   fib           computes Fib(size) by spawning both halves of every
+//                 call above the cutoff (grain), so tasks spawn tasks
+//   parallel_for  runs busy work over size items in chunks of grain
+//                 items; the scheduler splits the range recursively,
+//                 the pool gets every chunk from the caller
+//
+//   scheduler_bench [--schedulers=work_stealing,queue_pool]
+//                   [--workloads=fib,parallel_for] [--workers=1,2,4]
+//                   [--fib=30] [--cutoff=12] [--items=1048576]
+//                   [--grain=1024] [--work=64] [--rounds=5]
+
+#include "bench_util.hpp"
+
+#include "../2-cond-var/blocking-queue/solution.hpp"
+#include "../5-lock-free/work-stealing/solution.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using tpcc::solutions::WorkStealingScheduler;
+
+// Workers take tasks from one shared queue, which is what the work
+// stealing scheduler replaces. TaskGroup mirrors the scheduler's, but
+// Wait may only be called from outside the pool: a worker blocked in it
+// would hold back the tasks it waits for
+
+class QueuePool {
+  using Task = std::function<void()>;
+
+ public:
+  explicit QueuePool(const size_t num_workers) {
+    for (size_t i = 0; i < std::max<size_t>(num_workers, 1); ++i) {
+      workers_.emplace_back([this]() {
+        Task task_;
+        while (tasks_.Get(task_)) {
+          task_();
+        }
+      });
+    }
+  }
+
+  ~QueuePool() {
+    tasks_.Close();
+    for (auto& worker_ : workers_) {
+      worker_.join();
+    }
+  }
+
+  void Submit(Task task) {
+    tasks_.Put(std::move(task));
+  }
+
+  class TaskGroup {
+   public:
+    explicit TaskGroup(QueuePool& pool) : pool_(pool) {
+    }
+
+    ~TaskGroup() {
+      Wait();
+    }
+
+    // the last task finishes under the mutex, so Wait can't return and
+    // destroy the group before the task is done with it
+    template <class F>
+    void Spawn(F&& function) {
+      {
+        std::lock_guard<std::mutex> guard_(mutex_);
+        ++pending_;
+      }
+      pool_.Submit([this, function = std::forward<F>(function)]() mutable {
+        function();
+        std::lock_guard<std::mutex> guard_(mutex_);
+        if (--pending_ == 0) {
+          done_.notify_all();
+        }
+      });
+    }
+
+    void Wait() {
+      std::unique_lock<std::mutex> lock_(mutex_);
+      done_.wait(lock_, [this]() { return pending_ == 0; });
+    }
+
+   private:
+    QueuePool& pool_;
+    std::mutex mutex_;
+    size_t pending_{0};
+    std::condition_variable done_;
+  };
+
+ private:
+  tpcc::solutions::BlockingQueue<Task> tasks_;
+  std::vector<std::thread> workers_;
+};
+
+void ParallelFor(WorkStealingScheduler& scheduler, const size_t begin,
+                 const size_t end, const std::function<void(size_t)>& body,
+                 const size_t grain_size) {
+  scheduler.ParallelFor(begin, end, body, grain_size);
+}
+
+void ParallelFor(QueuePool& pool, const size_t begin, const size_t end,
+                 const std::function<void(size_t)>& body,
+                 const size_t grain_size) {
+  QueuePool::TaskGroup group_(pool);
+  for (size_t chunk_ = begin; chunk_ < end; chunk_ += grain_size) {
+    const size_t chunk_end_ = std::min(end, chunk_ + grain_size);
+    group_.Spawn([&body, chunk_, chunk_end_]() {
+      for (size_t i = chunk_; i < chunk_end_; ++i) {
+        body(i);
+      }
+    });
+  }
+  group_.Wait();
+}
+
+uint64_t SerialFib(const size_t n) {
+  return n < 2 ? n : SerialFib(n - 1) + SerialFib(n - 2);
+}
+
+template <class Group>
+void SpawnFib(Group& group, const size_t n, const size_t cutoff,
+              std::atomic<uint64_t>& sum) {
+  if (n < std::max<size_t>(cutoff, 2)) {
+    sum.fetch_add(SerialFib(n), std::memory_order_relaxed);
+    return void();
+  }
+  group.Spawn([&group, n, cutoff, &sum]() {
+    SpawnFib(group, n - 1, cutoff, sum);
+  });
+  SpawnFib(group, n - 2, cutoff, sum);
+}
+
+struct SchedulerConfig {
+  size_t workers_{1};
+  std::string workload_;
+  size_t size_{0};
+  size_t grain_{1};
+  size_t work_{64};
+  size_t rounds_{5};
+};
+
+struct SchedulerResult {
+  double mean_seconds_{0};
+  double min_seconds_{0};
+  bool correct_{true};
+};
+
+// returns false if the result is wrong
+template <class Pool>
+bool RunFib(Pool& pool, const SchedulerConfig& config) {
+  std::atomic<uint64_t> sum_{0};
+  {
+    typename Pool::TaskGroup group_(pool);
+    SpawnFib(group_, config.size_, config.grain_, sum_);
+    group_.Wait();
+  }
+  return sum_.load() == SerialFib(config.size_);
+}
+
+template <class Pool>
+bool RunParallelFor(Pool& pool, const SchedulerConfig& config) {
+  std::vector<uint64_t> items_(config.size_, 0);
+  ParallelFor(
+      pool, 0, config.size_,
+      [&](size_t i) {
+        items_[i] = tpcc::bench::detail::BusyWork(config.work_, i) | 1;
+      },
+      std::max<size_t>(config.grain_, 1));
+  return std::find(items_.begin(), items_.end(), 0) == items_.end();
+}
+
+template <class Pool>
+SchedulerResult RunScheduler(const SchedulerConfig& config) {
+  Pool pool_(config.workers_);
+  SchedulerResult result_;
+  double total_seconds_ = 0;
+  for (size_t round_ = 0; round_ < config.rounds_; ++round_) {
+    const auto start_ = std::chrono::steady_clock::now();
+    const bool correct_ = config.workload_ == "fib"
+                              ? RunFib(pool_, config)
+                              : RunParallelFor(pool_, config);
+    const double seconds_ = std::chrono::duration<double>(
+                                std::chrono::steady_clock::now() - start_)
+                                .count();
+    result_.correct_ = result_.correct_ && correct_;
+    total_seconds_ += seconds_;
+    if (round_ == 0 || seconds_ < result_.min_seconds_) {
+      result_.min_seconds_ = seconds_;
+    }
+  }
+  result_.mean_seconds_ =
+      total_seconds_ / std::max<size_t>(config.rounds_, 1);
+  return result_;
+}
+
+struct SchedulerEntry {
+  const char* name_;
+  SchedulerResult (*run_)(const SchedulerConfig&);
+};
+
+const SchedulerEntry kSchedulers[] = {
+    {"work_stealing", &RunScheduler<WorkStealingScheduler>},
+    {"queue_pool", &RunScheduler<QueuePool>},
+};
+
+const char* const kWorkloads[] = {"fib", "parallel_for"};
+
+struct Options {
+  std::vector<std::string> schedulers_;
+  std::vector<std::string> workloads_;
+  std::vector<size_t> workers_;
+  size_t fib_{30};
+  size_t cutoff_{12};
+  size_t items_{1048576};
+  size_t grain_{1024};
+  size_t work_{64};
+  size_t rounds_{5};
+};
+
+const char* const kUsage =
+    "scheduler_bench [--schedulers=a,b] [--workloads=a,b] [--workers=n,m] "
+    "[--fib=n] [--cutoff=n] [--items=n] [--grain=n] [--work=n] "
+    "[--rounds=n]";
+
+Options ParseOptions(int argc, char** argv) {
+  Options options_;
+  for (const auto& argument_ :
+       tpcc::bench::ParseKeyValues(argc, argv, kUsage)) {
+    const std::string& key_ = argument_.first;
+    const std::string& value_ = argument_.second;
+    if (key_ == "schedulers") {
+      options_.schedulers_ = tpcc::bench::SplitList(value_);
+    } else if (key_ == "workloads") {
+      options_.workloads_ = tpcc::bench::SplitList(value_);
+    } else if (key_ == "workers") {
+      options_.workers_ = tpcc::bench::ParseNumbers(value_);
+    } else if (key_ == "fib") {
+      options_.fib_ = std::stoul(value_);
+    } else if (key_ == "cutoff") {
+      options_.cutoff_ = std::stoul(value_);
+    } else if (key_ == "items") {
+      options_.items_ = std::stoul(value_);
+    } else if (key_ == "grain") {
+      options_.grain_ = std::stoul(value_);
+    } else if (key_ == "work") {
+      options_.work_ = std::stoul(value_);
+    } else if (key_ == "rounds") {
+      options_.rounds_ = std::stoul(value_);
+    } else {
+      tpcc::bench::Usage(key_.c_str(), kUsage);
+    }
+  }
+  return options_;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const Options options_ = ParseOptions(argc, argv);
+  const size_t hardware_threads_ = tpcc::bench::GetHardwareThreads();
+
+  std::printf(
+      "workload,scheduler,workers,hardware_threads,size,grain,rounds,"
+      "mean_seconds,min_seconds,correct\n");
+
+  for (const char* workload_ : kWorkloads) {
+    if (!tpcc::bench::IsSelected(options_.workloads_, workload_)) {
+      continue;
+    }
+    const bool fib_ = std::string(workload_) == "fib";
+    for (const SchedulerEntry& scheduler_ : kSchedulers) {
+      if (!tpcc::bench::IsSelected(options_.schedulers_, scheduler_.name_)) {
+        continue;
+      }
+      for (size_t workers_ : tpcc::bench::GetThreadCounts(
+               options_.workers_, {}, hardware_threads_)) {
+        SchedulerConfig config_;
+        config_.workers_ = workers_;
+        config_.workload_ = workload_;
+        config_.size_ = fib_ ? options_.fib_ : options_.items_;
+        config_.grain_ = fib_ ? options_.cutoff_ : options_.grain_;
+        config_.work_ = options_.work_;
+        config_.rounds_ = options_.rounds_;
+        const SchedulerResult result_ = scheduler_.run_(config_);
+        std::printf("%s,%s,%zu,%zu,%zu,%zu,%zu,%.6f,%.6f,%d\n", workload_,
+                    scheduler_.name_, workers_, hardware_threads_,
+                    config_.size_, config_.grain_, config_.rounds_,
+                    result_.mean_seconds_, result_.min_seconds_,
+                    result_.correct_ ? 1 : 0);
+        std::fflush(stdout);
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,195 @@
+// Ordered set benchmark: the set is filled with every other key of the
+// range, then threads run a mix of Contains and Insert/Remove on random
+// keys of the whole range, so about half of the lookups hit. Compares
+// the optimistic skip list, the optimistic linked list and the lock-free
+// linked list over growing key ranges and prints one CSV row per run to
+// stdout. Oversubscribed runs show how the lock-based sets stall when a
+// node lock holder is preempted. The optimistic sets run with every node
+// lock policy, so the CSV is a policy x thread count x key range matrix.
+//
+//   set_bench [--sets=linked,skiplist,lockfree]
+//             [--policies=spin,backoff,ticket,queue,adaptive]
+//             [--threads=1,2,4] [--oversubscription=2,4]
+//             [--keys=64,1024,65536] [--reads=90,50] [--duration-ms=200]
+
+#include "bench_util.hpp"
+
+#include "../1-mutex/futex/solution.hpp"
+#include "../1-mutex/try-lock/solution.hpp"
+#include "../3-fine-grained/optimistic-list/solution.hpp"
+#include "../4-cache/queue-spinlock/solution.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace {
+
+using tpcc::bench::ThroughputResult;
+
+struct SetConfig {
+  size_t threads_{1};
+  size_t keys_{1024};
+  // percentage of Contains, the rest is split between Insert and Remove
+  size_t reads_{90};
+  std::chrono::milliseconds duration_{200};
+};
+
+// nodes come from the allocator of the run and are freed with it
+template <class Set>
+ThroughputResult RunSet(const SetConfig& config) {
+  tpcc::BumpPointerAllocator allocator_;
+  Set set_(allocator_);
+  for (int64_t key_ = 0; key_ < static_cast<int64_t>(config.keys_);
+       key_ += 2) {
+    set_.Insert(key_);
+  }
+
+  return tpcc::bench::RunThroughput(
+      config.threads_, config.duration_,
+      [&](size_t /*thread_index*/, uint64_t& random) {
+        const uint64_t draw_ = tpcc::bench::detail::NextRandom(random);
+        const int64_t key_ = static_cast<int64_t>((draw_ >> 8) % config.keys_);
+        const size_t percent_ = draw_ % 100;
+        if (percent_ < config.reads_) {
+          random ^= set_.Contains(key_);
+        } else if (percent_ % 2 == 0) {
+          set_.Insert(key_);
+        } else {
+          set_.Remove(key_);
+        }
+      });
+}
+
+struct SetEntry {
+  const char* name_;
+  const char* policy_;
+  ThroughputResult (*run_)(const SetConfig&);
+};
+
+using tpcc::solutions::AdaptiveLock;
+using tpcc::solutions::BackoffSpinLock;
+using tpcc::solutions::GuardLockableAdapter;
+using tpcc::solutions::KeyTraits;
+using tpcc::solutions::LockableAdapter;
+using tpcc::solutions::QueueSpinLock;
+using tpcc::solutions::SpinLock;
+using tpcc::solutions::TicketLock;
+
+template <class NodeLock>
+using LinkedSet = tpcc::solutions::OptimisticLinkedSet<int64_t,
+                                                       KeyTraits<int64_t>,
+                                                       NodeLock>;
+
+template <class NodeLock>
+using SkipListSet = tpcc::solutions::OptimisticSkipListSet<int64_t,
+                                                           KeyTraits<int64_t>,
+                                                           NodeLock>;
+
+const char* const kNoPolicy = "none";
+
+const SetEntry kSets[] = {
+    {"linked", "spin", &RunSet<LinkedSet<SpinLock>>},
+    {"linked", "backoff", &RunSet<LinkedSet<BackoffSpinLock>>},
+    {"linked", "ticket", &RunSet<LinkedSet<LockableAdapter<TicketLock>>>},
+    {"linked", "queue",
+     &RunSet<LinkedSet<GuardLockableAdapter<QueueSpinLock>>>},
+    {"linked", "adaptive",
+     &RunSet<LinkedSet<LockableAdapter<AdaptiveLock>>>},
+    {"skiplist", "spin", &RunSet<SkipListSet<SpinLock>>},
+    {"skiplist", "backoff", &RunSet<SkipListSet<BackoffSpinLock>>},
+    {"skiplist", "ticket",
+     &RunSet<SkipListSet<LockableAdapter<TicketLock>>>},
+    {"skiplist", "queue",
+     &RunSet<SkipListSet<GuardLockableAdapter<QueueSpinLock>>>},
+    {"skiplist", "adaptive",
+     &RunSet<SkipListSet<LockableAdapter<AdaptiveLock>>>},
+    {"lockfree", kNoPolicy,
+     &RunSet<tpcc::solutions::LockFreeLinkedSet<int64_t>>},
+};
+
+struct Options {
+  std::vector<std::string> sets_;
+  std::vector<std::string> policies_;
+  std::vector<size_t> threads_;
+  std::vector<size_t> oversubscription_{2, 4};
+  std::vector<size_t> keys_{64, 1024, 65536};
+  std::vector<size_t> reads_{90, 50};
+  size_t duration_ms_{200};
+};
+
+const char* const kUsage =
+    "set_bench [--sets=a,b] [--policies=a,b] [--threads=n,m] "
+    "[--oversubscription=k,l] [--keys=n,m] [--reads=p,q] [--duration-ms=n]";
+
+Options ParseOptions(int argc, char** argv) {
+  using tpcc::bench::ParseNumbers;
+  Options options_;
+  for (const auto& argument_ :
+       tpcc::bench::ParseKeyValues(argc, argv, kUsage)) {
+    const std::string& key_ = argument_.first;
+    const std::string& value_ = argument_.second;
+    if (key_ == "sets") {
+      options_.sets_ = tpcc::bench::SplitList(value_);
+    } else if (key_ == "policies") {
+      options_.policies_ = tpcc::bench::SplitList(value_);
+    } else if (key_ == "threads") {
+      options_.threads_ = ParseNumbers(value_);
+    } else if (key_ == "oversubscription") {
+      options_.oversubscription_ = ParseNumbers(value_);
+    } else if (key_ == "keys") {
+      options_.keys_ = ParseNumbers(value_);
+    } else if (key_ == "reads") {
+      options_.reads_ = ParseNumbers(value_);
+    } else if (key_ == "duration-ms") {
+      options_.duration_ms_ = std::stoul(value_);
+    } else {
+      tpcc::bench::Usage(key_.c_str(), kUsage);
+    }
+  }
+  return options_;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const Options options_ = ParseOptions(argc, argv);
+  const size_t hardware_threads_ = tpcc::bench::GetHardwareThreads();
+
+  std::printf(
+      "set,policy,threads,hardware_threads,keys,reads_percent,seconds,"
+      "operations,operations_per_s\n");
+
+  for (const SetEntry& set_ : kSets) {
+    // the lock-free set has no node locks and runs whatever the policies
+    if (!tpcc::bench::IsSelected(options_.sets_, set_.name_) ||
+        (set_.policy_ != std::string(kNoPolicy) &&
+         !tpcc::bench::IsSelected(options_.policies_, set_.policy_))) {
+      continue;
+    }
+    for (size_t threads_ : tpcc::bench::GetThreadCounts(
+             options_.threads_, options_.oversubscription_,
+             hardware_threads_)) {
+      for (size_t keys_ : options_.keys_) {
+        for (size_t reads_ : options_.reads_) {
+          SetConfig config_;
+          config_.threads_ = threads_;
+          config_.keys_ = keys_;
+          config_.reads_ = reads_;
+          config_.duration_ =
+              std::chrono::milliseconds(options_.duration_ms_);
+          const ThroughputResult result_ = set_.run_(config_);
+          std::printf("%s,%s,%zu,%zu,%zu,%zu,%.6f,%llu,%.1f\n",
+                      set_.name_, set_.policy_, threads_, hardware_threads_,
+                      keys_, reads_, result_.seconds_,
+                      static_cast<unsigned long long>(result_.operations_),
+                      result_.operations_ / result_.seconds_);
+          std::fflush(stdout);
+        }
+      }
+    }
+  }
+  return 0;
+}
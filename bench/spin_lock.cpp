@@ -0,0 +1,15 @@
+#include "lock_bench.hpp"
+
+#include "../3-fine-grained/optimistic-list/solution.hpp"
+
+namespace tpcc {
+namespace bench {
+
+// the node lock of the optimistic list
+BenchResult RunSpinLock(const BenchConfig& config) {
+  LockUnlockAdapter<solutions::SpinLock> lock_;
+  return RunBench(lock_, config);
+}
+
+}  // namespace bench
+}  // namespace tpcc
@@ -0,0 +1,191 @@
+// Stack benchmark: every thread pushes and pops in a loop, so Pushes and
+// Pops collide on the top. Compares LockFreeStack with its elimination
+// array against the plain Treiber loop over the same tagged top, and
+// prints one CSV row per run to stdout.
+//
+//   stack_bench [--stacks=elimination,treiber] [--threads=1,2,4]
+//               [--oversubscription=2] [--prefill=0,1024]
+//               [--duration-ms=200]
+
+#include "bench_util.hpp"
+
+#include "../5-lock-free/stack/solution.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using tpcc::bench::ThroughputResult;
+
+// Push/Pop retry on top_ until they win, as in LockFreeStack before the
+// elimination array. Nodes are recycled through pools per thread index,
+// so neither stack pays for the allocator
+
+template <typename T>
+class TreiberStack {
+  struct Node {
+    T item_;
+    std::atomic<Node*> next{nullptr};
+  };
+
+ public:
+  explicit TreiberStack(const size_t threads) : pools_(threads) {
+  }
+
+  ~TreiberStack() {
+    Node* node_;
+    while ((node_ = stack_.Pop()) != nullptr) {
+      delete node_;
+    }
+    for (auto& pool_ : pools_) {
+      for (Node* spare_ : pool_) {
+        delete spare_;
+      }
+    }
+  }
+
+  void Push(const size_t thread_index, T item) {
+    auto& pool_ = pools_[thread_index];
+    Node* node_;
+    if (pool_.empty()) {
+      node_ = new Node();
+    } else {
+      node_ = pool_.back();
+      pool_.pop_back();
+    }
+    node_->item_ = std::move(item);
+    stack_.Push(node_);
+  }
+
+  bool Pop(const size_t thread_index, T& item) {
+    Node* node_ = stack_.Pop();
+    if (node_ == nullptr) {
+      return false;
+    }
+    item = std::move(node_->item_);
+    pools_[thread_index].push_back(node_);
+    return true;
+  }
+
+ private:
+  tpcc::solutions::TaggedStack<Node> stack_;
+  std::vector<std::vector<Node*>> pools_;
+};
+
+template <typename T>
+class EliminationStack {
+ public:
+  explicit EliminationStack(size_t /*threads*/) {
+  }
+
+  void Push(size_t /*thread_index*/, T item) {
+    stack_.Push(std::move(item));
+  }
+
+  bool Pop(size_t /*thread_index*/, T& item) {
+    return stack_.Pop(item);
+  }
+
+ private:
+  tpcc::solutions::LockFreeStack<T> stack_;
+};
+
+// one operation is a Push followed by a Pop
+template <class Stack>
+ThroughputResult RunStack(const size_t threads, const size_t prefill,
+                          const std::chrono::milliseconds duration) {
+  Stack stack_(threads);
+  for (size_t i = 0; i < prefill; ++i) {
+    stack_.Push(0, i);
+  }
+  return tpcc::bench::RunThroughput(
+      threads, duration, [&stack_](size_t thread_index, uint64_t& random) {
+        stack_.Push(thread_index, random);
+        uint64_t item_ = 0;
+        stack_.Pop(thread_index, item_);
+        random ^= item_;
+      });
+}
+
+struct StackEntry {
+  const char* name_;
+  ThroughputResult (*run_)(size_t, size_t, std::chrono::milliseconds);
+};
+
+const StackEntry kStacks[] = {
+    {"elimination", &RunStack<EliminationStack<uint64_t>>},
+    {"treiber", &RunStack<TreiberStack<uint64_t>>},
+};
+
+struct Options {
+  std::vector<std::string> stacks_;
+  std::vector<size_t> threads_;
+  std::vector<size_t> oversubscription_{2};
+  std::vector<size_t> prefill_{0, 1024};
+  size_t duration_ms_{200};
+};
+
+const char* const kUsage =
+    "stack_bench [--stacks=a,b] [--threads=n,m] [--oversubscription=k,l] "
+    "[--prefill=n,m] [--duration-ms=n]";
+
+Options ParseOptions(int argc, char** argv) {
+  using tpcc::bench::ParseNumbers;
+  Options options_;
+  for (const auto& argument_ :
+       tpcc::bench::ParseKeyValues(argc, argv, kUsage)) {
+    const std::string& key_ = argument_.first;
+    const std::string& value_ = argument_.second;
+    if (key_ == "stacks") {
+      options_.stacks_ = tpcc::bench::SplitList(value_);
+    } else if (key_ == "threads") {
+      options_.threads_ = ParseNumbers(value_);
+    } else if (key_ == "oversubscription") {
+      options_.oversubscription_ = ParseNumbers(value_);
+    } else if (key_ == "prefill") {
+      options_.prefill_ = ParseNumbers(value_);
+    } else if (key_ == "duration-ms") {
+      options_.duration_ms_ = std::stoul(value_);
+    } else {
+      tpcc::bench::Usage(key_.c_str(), kUsage);
+    }
+  }
+  return options_;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const Options options_ = ParseOptions(argc, argv);
+  const size_t hardware_threads_ = tpcc::bench::GetHardwareThreads();
+
+  std::printf(
+      "stack,threads,hardware_threads,prefill,seconds,push_pop_pairs,"
+      "pairs_per_s\n");
+
+  for (const StackEntry& stack_ : kStacks) {
+    if (!tpcc::bench::IsSelected(options_.stacks_, stack_.name_)) {
+      continue;
+    }
+    for (size_t threads_ : tpcc::bench::GetThreadCounts(
+             options_.threads_, options_.oversubscription_,
+             hardware_threads_)) {
+      for (size_t prefill_ : options_.prefill_) {
+        const ThroughputResult result_ = stack_.run_(
+            threads_, prefill_,
+            std::chrono::milliseconds(options_.duration_ms_));
+        std::printf("%s,%zu,%zu,%zu,%.6f,%llu,%.1f\n", stack_.name_,
+                    threads_, hardware_threads_, prefill_, result_.seconds_,
+                    static_cast<unsigned long long>(result_.operations_),
+                    result_.operations_ / result_.seconds_);
+        std::fflush(stdout);
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,30 @@
+#include "lock_bench.hpp"
+
+#include <mutex>
+
+namespace tpcc {
+namespace bench {
+
+namespace {
+
+class StdMutexAdapter {
+ public:
+  template <class F>
+  void Run(F&& critical_section) {
+    std::lock_guard<std::mutex> guard_(mutex_);
+    critical_section();
+  }
+
+ private:
+  std::mutex mutex_;
+};
+
+}  // namespace
+
+BenchResult RunStdMutex(const BenchConfig& config) {
+  StdMutexAdapter lock_;
+  return RunBench(lock_, config);
+}
+
+}  // namespace bench
+}  // namespace tpcc
@@ -0,0 +1,14 @@
+#include "lock_bench.hpp"
+
+#include "../1-mutex/try-lock/solution.hpp"
+
+namespace tpcc {
+namespace bench {
+
+BenchResult RunTicketLock(const BenchConfig& config) {
+  LockUnlockAdapter<solutions::TicketLock> lock_;
+  return RunBench(lock_, config);
+}
+
+}  // namespace bench
+}  // namespace tpcc
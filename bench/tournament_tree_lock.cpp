@@ -0,0 +1,15 @@
+#include "lock_bench.hpp"
+
+#include "../1-mutex/tournament-tree/solution.hpp"
+
+namespace tpcc {
+namespace bench {
+
+// threads get their leaves from the lock's slot registry
+BenchResult RunTournamentTreeLock(const BenchConfig& config) {
+  LockUnlockAdapter<solutions::TournamentTreeLock> lock_(config.threads_);
+  return RunBench(lock_, config);
+}
+
+}  // namespace bench
+}  // namespace tpcc